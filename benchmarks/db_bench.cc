@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <atomic>
+
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -25,11 +27,17 @@
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
 //      fill100K      -- write N/1000 100K values in random order in async mode
+//      fillmanyl0    -- write N values spread over --level0_files level-0
+//                       files that each cover the whole key range, and
+//                       keep them from being compacted (for readseq, etc.
+//                       to measure merging many files)
 //      deleteseq     -- delete N keys in sequential order
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      readrandompinned -- readrandom, but with the Get() that pins values
+//                       instead of copying them
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
@@ -39,6 +47,8 @@
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
 //      sstables    -- Print sstable info
+//      writeamp    -- Print the write amplification of the writes done
+//                     since the db was opened
 //      heapprofile -- Dump a heap profile (if supported by this port)
 static const char* FLAGS_benchmarks =
     "fillseq,"
@@ -85,10 +95,25 @@ static int FLAGS_write_buffer_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
 
+// Growth of the file size per level below level-1.
+// (initialized to default value by "main")
+static int FLAGS_max_file_size_multiplier = 0;
+
+// Fraction of the file size at which compaction outputs are cut at
+// file boundaries of the next level; 0 disables.
+static double FLAGS_compaction_output_alignment_ratio = 0;
+
 // Approximate size of user data packed per block (before compression.
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// Number of keys between restart points in index blocks
+// (initialized to default value by "main")
+static int FLAGS_index_block_restart_interval = 0;
+
+// If true, delta-encode the block handles in index blocks
+static bool FLAGS_delta_encode_index_handles = false;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
@@ -108,6 +133,12 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// Compaction style: 0 for leveled, 1 for universal, 2 for FIFO.
+static int FLAGS_compaction_style = leveldb::kCompactionStyleLevel;
+
+// Number of level-0 files written by fillmanyl0.
+static int FLAGS_level0_files = 16;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -318,6 +349,8 @@ class Benchmark {
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  std::atomic<int64_t> user_bytes_written_;  // Written by the fill benchmarks
+  bool keep_level0_files_;  // Open() the next database with FIFO compaction
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -404,7 +437,9 @@ class Benchmark {
         value_size_(FLAGS_value_size),
         entries_per_batch_(1),
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-        heap_counter_(0) {
+        heap_counter_(0),
+        user_bytes_written_(0),
+        keep_level0_files_(false) {
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -477,12 +512,18 @@ class Benchmark {
         num_ /= 1000;
         value_size_ = 100 * 1000;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillmanyl0")) {
+        fresh_db = true;
+        keep_level0_files_ = true;
+        method = &Benchmark::WriteManyLevel0;
       } else if (name == Slice("readseq")) {
         method = &Benchmark::ReadSequential;
       } else if (name == Slice("readreverse")) {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("readrandompinned")) {
+        method = &Benchmark::ReadRandomPinned;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -513,6 +554,8 @@ class Benchmark {
         PrintStats("leveldb.stats");
       } else if (name == Slice("sstables")) {
         PrintStats("leveldb.sstables");
+      } else if (name == Slice("writeamp")) {
+        PrintWriteAmplification();
       } else {
         if (!name.empty()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -529,6 +572,7 @@ class Benchmark {
           db_ = nullptr;
           DestroyDB(FLAGS_db, Options());
           Open();
+          keep_level0_files_ = false;
         }
       }
 
@@ -685,15 +729,26 @@ class Benchmark {
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
+    options.max_file_size_multiplier = FLAGS_max_file_size_multiplier;
+    options.compaction_output_alignment_ratio =
+        FLAGS_compaction_output_alignment_ratio;
     options.block_size = FLAGS_block_size;
+    options.index_block_restart_interval = FLAGS_index_block_restart_interval;
+    options.delta_encode_index_handles = FLAGS_delta_encode_index_handles;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.compaction_style =
+        keep_level0_files_
+            ? kCompactionStyleFIFO
+            : static_cast<CompactionStyle>(FLAGS_compaction_style);
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
       exit(1);
     }
+    // The DB counts table writes from the time it is opened.
+    user_bytes_written_.store(0, std::memory_order_relaxed);
   }
 
   void OpenBench(ThreadState* thread) {
@@ -708,6 +763,38 @@ class Benchmark {
 
   void WriteRandom(ThreadState* thread) { DoWrite(thread, false); }
 
+  void WriteManyLevel0(ThreadState* thread) {
+    // File f holds keys f, f + level0_files, f + 2 * level0_files, ...
+    // so an iterator has to merge all files for every key.
+    RandomGenerator gen;
+    Status s;
+    int64_t bytes = 0;
+    for (int f = 0; f < FLAGS_level0_files && s.ok(); f++) {
+      for (int k = f; k < num_ && s.ok(); k += FLAGS_level0_files) {
+        char key[100];
+        snprintf(key, sizeof(key), "%016d", k);
+        s = db_->Put(write_options_, key, gen.Generate(value_size_));
+        bytes += value_size_ + strlen(key);
+        thread->stats.FinishedSingleOp();
+      }
+      if (s.ok()) {
+        // Flush the memtable into a level-0 file of its own
+        db_->CompactRange(nullptr, nullptr);
+      }
+    }
+    if (!s.ok()) {
+      fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+    std::string files;
+    db_->GetProperty("leveldb.num-files-at-level0", &files);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%s level-0 files)", files.c_str());
+    thread->stats.AddMessage(msg);
+    thread->stats.AddBytes(bytes);
+    user_bytes_written_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
   void DoWrite(ThreadState* thread, bool seq) {
     if (num_ != FLAGS_num) {
       char msg[100];
@@ -736,6 +823,7 @@ class Benchmark {
       }
     }
     thread->stats.AddBytes(bytes);
+    user_bytes_written_.fetch_add(bytes, std::memory_order_relaxed);
   }
 
   void ReadSequential(ThreadState* thread) {
@@ -782,6 +870,24 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void ReadRandomPinned(ThreadState* thread) {
+    ReadOptions options;
+    PinnableSlice value;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      char key[100];
+      const int k = thread->rand.Next() % FLAGS_num;
+      snprintf(key, sizeof(key), "%016d", k);
+      if (db_->Get(options, key, &value).ok()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -882,6 +988,24 @@ class Benchmark {
 
   void Compact(ThreadState* thread) { db_->CompactRange(nullptr, nullptr); }
 
+  void PrintWriteAmplification() {
+    std::string table_bytes;
+    if (!db_->GetProperty("leveldb.table-bytes-written", &table_bytes)) {
+      fprintf(stdout, "writeamp     : (failed)\n");
+      return;
+    }
+    const double user_mb =
+        user_bytes_written_.load(std::memory_order_relaxed) / 1048576.0;
+    const double table_mb = strtoll(table_bytes.c_str(), nullptr, 10) / 1048576.0;
+    fprintf(stdout,
+            "writeamp     : %11.3f (%.1f MB written, %.1f MB to tables, "
+            "%s compaction)\n",
+            user_mb > 0 ? table_mb / user_mb : 0.0, user_mb, table_mb,
+            FLAGS_compaction_style == kCompactionStyleUniversal ? "universal"
+            : FLAGS_compaction_style == kCompactionStyleFIFO    ? "FIFO"
+                                                                : "leveled");
+  }
+
   void PrintStats(const char* key) {
     std::string stats;
     if (!db_->GetProperty(key, &stats)) {
@@ -917,7 +1041,10 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
+  FLAGS_max_file_size_multiplier = leveldb::Options().max_file_size_multiplier;
   FLAGS_block_size = leveldb::Options().block_size;
+  FLAGS_index_block_restart_interval =
+      leveldb::Options().index_block_restart_interval;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
 
@@ -935,6 +1062,9 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--compaction_style=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_compaction_style = n;
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
@@ -948,10 +1078,26 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--level0_files=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_level0_files = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--max_file_size_multiplier=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_file_size_multiplier = n;
+    } else if (sscanf(argv[i], "--compaction_output_alignment_ratio=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_compaction_output_alignment_ratio = d;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--index_block_restart_interval=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_index_block_restart_interval = n;
+    } else if (sscanf(argv[i], "--delta_encode_index_handles=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_delta_encode_index_handles = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
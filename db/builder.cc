@@ -4,6 +4,8 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
+
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/table_cache.h"
@@ -30,13 +32,28 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
+    meta->smallest_seqno = kMaxSequenceNumber;
+    meta->largest_seqno = 0;
+    meta->creation_time = env->NowMicros() / 1000000;
+    ParsedInternalKey parsed;
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
+      if (ParseInternalKey(key, &parsed)) {
+        meta->smallest_seqno = std::min(meta->smallest_seqno, parsed.sequence);
+        meta->largest_seqno = std::max(meta->largest_seqno, parsed.sequence);
+        if (parsed.type == kTypeDeletion) {
+          meta->num_deletions++;
+        }
+      }
+      meta->num_entries++;
       builder->Add(key, iter->value());
     }
 
     // Finish and check for builder errors
+    builder->SetInternalKeyProperties(meta->num_deletions,
+                                      meta->smallest_seqno,
+                                      meta->largest_seqno);
     s = builder->Finish();
     if (s.ok()) {
       meta->file_size = builder->FileSize();
@@ -20,14 +20,19 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/tailing_iter.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "table/merger.h"
@@ -40,14 +45,25 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Names of the values of CompactionReason, as reported by GetProperty().
+static const char* const kCompactionReasonNames[kNumCompactionReasons] = {
+    "size", "seek", "marked", "intra-l0", "universal", "fifo", "manual"};
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        manual_wal_flush(false),
+        exclusive(false),
+        done(false),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
+  bool manual_wal_flush;
+  bool exclusive;  // Must not be absorbed into another writer's group
   bool done;
   port::CondVar cv;
 };
@@ -58,19 +74,26 @@ struct DBImpl::CompactionState {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    SequenceNumber smallest_seqno, largest_seqno;
+    uint64_t num_entries, num_deletions;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
+        is_manual(false),
         smallest_snapshot(0),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        num_input_records(0) {}
 
   Compaction* const compaction;
 
+  // True if the compaction was requested through CompactRange().
+  bool is_manual;
+
   // Sequence numbers < smallest_snapshot are not significant since we
   // will never have to service a snapshot below smallest_snapshot.
   // Therefore if we have seen a sequence number S <= smallest_snapshot,
@@ -84,6 +107,9 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+
+  // Number of entries read from the inputs so far.
+  uint64_t num_input_records;
 };
 
 // Fix user-supplied options to be reasonable
@@ -95,14 +121,26 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&result.max_write_buffer_number, 2, 64);
+  ClipToRange(&result.delayed_write_rate, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
+  ClipToRange(&result.max_file_size_multiplier, 1, 100);
+  ClipToRange(&result.compaction_output_alignment_ratio, 0.0, 1.0);
+  ClipToRange(&result.max_bytes_for_level_base, uint64_t{64} << 10,
+              uint64_t{1} << 40);
+  ClipToRange(&result.max_bytes_for_level_multiplier, 2, 100);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.index_block_restart_interval, 1, 1024);
+  ClipToRange(&result.read_sampling_period, size_t{0}, size_t{1} << 29);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -128,8 +166,10 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -138,17 +178,21 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      min_recyclable_log_number_(0),
       tmp_batch_(new WriteBatch),
       background_compaction_scheduled_(false),
       manual_compaction_(nullptr),
+      ingesting_(false),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      compactions_by_reason_(),
+      last_reported_micros_(env_->NowMicros()),
+      next_write_micros_(0) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
@@ -165,7 +209,9 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
+  for (MemTable* imm : imm_) {
+    imm->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -244,6 +290,19 @@ void DBImpl::DeleteObsoleteFiles() {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
                   (number == versions_->PrevLogNumber()));
+          if (!keep && min_recyclable_log_number_ != 0 &&
+              number >= min_recyclable_log_number_) {
+            if (std::find(log_recycle_files_.begin(), log_recycle_files_.end(),
+                          number) != log_recycle_files_.end()) {
+              keep = true;
+            } else if (log_recycle_files_.size() <
+                       static_cast<size_t>(options_.recycle_log_file_num)) {
+              Log(options_.info_log, "Recycle log #%llu\n",
+                  static_cast<unsigned long long>(number));
+              log_recycle_files_.push_back(number);
+              keep = true;
+            }
+          }
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -405,7 +464,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   // paranoid_checks==false so that corruptions cause entire commits
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/,
+                     log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
@@ -441,7 +501,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = WriteLevel0Table({mem}, edit, nullptr);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -454,8 +514,10 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 
   delete file;
 
-  // See if we should keep reusing the last log file.
-  if (status.ok() && options_.reuse_logs && last_log && compactions == 0) {
+  // See if we should keep reusing the last log file.  A recyclable log may
+  // hold stale data past its end, so it cannot be appended to.
+  if (status.ok() && options_.reuse_logs && last_log && compactions == 0 &&
+      !reader.IsRecyclable()) {
     assert(logfile_ == nullptr);
     assert(log_ == nullptr);
     assert(mem_ == nullptr);
@@ -463,7 +525,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (env_->GetFileSize(fname, &lfile_size).ok() &&
         env_->NewAppendableFile(fname, &logfile_).ok()) {
       Log(options_.info_log, "Reusing old log %s \n", fname.c_str());
-      log_ = new log::Writer(logfile_, lfile_size);
+      log_ =
+          new log::Writer(logfile_, lfile_size, options_.wal_compression);
       logfile_number_ = log_number;
       if (mem != nullptr) {
         mem_ = mem;
@@ -480,7 +543,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = WriteLevel0Table({mem}, edit, nullptr);
     }
     mem->Unref();
   }
@@ -488,16 +551,21 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+Status DBImpl::WriteLevel0Table(const std::vector<MemTable*>& mems,
+                                VersionEdit* edit, Version* base) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
-  Log(options_.info_log, "Level-0 table #%llu: started",
-      (unsigned long long)meta.number);
+  std::vector<Iterator*> list;
+  for (MemTable* mem : mems) {
+    list.push_back(mem->NewIterator());
+  }
+  Iterator* iter =
+      NewMergingIterator(&internal_comparator_, &list[0], list.size());
+  Log(options_.info_log, "Level-0 table #%llu: started from %d memtables",
+      (unsigned long long)meta.number, static_cast<int>(mems.size()));
 
   Status s;
   {
@@ -521,44 +589,53 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != nullptr) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
+  stats.count = 1;
   stats.micros = env_->NowMicros() - start_micros;
   stats.bytes_written = meta.file_size;
+  stats.bytes_flushed = meta.file_size;
   stats_[level].Add(stats);
   return s;
 }
 
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
+  assert(!imm_.empty());
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of all waiting memtables as a single new Table.
+  // More memtables may be queued while the lock is released below; they
+  // are left for the next compaction.
+  const std::vector<MemTable*> mems = imm_;
+  const uint64_t log_number = imm_log_numbers_[mems.size() - 1];
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s = WriteLevel0Table(mems, &edit, base);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace immutable memtables with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
+    edit.SetLogNumber(log_number);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    for (MemTable* mem : mems) {
+      mem->Unref();
+    }
+    imm_.erase(imm_.begin(), imm_.begin() + mems.size());
+    imm_log_numbers_.erase(imm_log_numbers_.begin(),
+                           imm_log_numbers_.begin() + mems.size());
+    has_imm_.store(!imm_.empty(), std::memory_order_release);
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -627,10 +704,10 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -653,9 +730,11 @@ void DBImpl::MaybeScheduleCompaction() {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
+  } else if (imm_.empty() && manual_compaction_ == nullptr &&
              !versions_->NeedsCompaction()) {
     // No work to be done
+  } else if (imm_.empty() && ingesting_) {
+    // Only memtable flushes run while a file is being ingested
   } else {
     background_compaction_scheduled_ = true;
     env_->Schedule(&DBImpl::BGWork, this);
@@ -689,11 +768,15 @@ void DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
   // 将im memtable的数据写到level0文件中
-  if (imm_ != nullptr) {
+  if (!imm_.empty()) {
     CompactMemTable();
     return;
   }
 
+  if (ingesting_) {
+    return;
+  }
+
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
@@ -716,24 +799,51 @@ void DBImpl::BackgroundCompaction() {
   Status status;
   if (c == nullptr) {
     // Nothing to do
-  } else if (!is_manual && c->IsTrivialMove()) {
-    // Move file to next level
-    assert(c->num_input_files(0) == 1);
-    FileMetaData* f = c->input(0, 0);
-    c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+  } else if (c->IsDeletionCompaction()) {
+    // Drop the oldest files without rewriting anything
+    compactions_by_reason_[c->reason()]++;
+    c->AddInputDeletions(c->edit());
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
+    int64_t bytes = 0;
+    for (int i = 0; i < c->num_input_files(0); i++) {
+      bytes += c->input(0, i)->file_size;
+    }
     VersionSet::LevelSummaryStorage tmp;
-    Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
-        static_cast<unsigned long long>(f->file_size),
+    Log(options_.info_log, "Dropped %d@%d files %lld bytes %s: %s\n",
+        c->num_input_files(0), c->level(), static_cast<long long>(bytes),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
+    c->ReleaseInputs();
+    DeleteObsoleteFiles();
+  } else if (!is_manual && c->IsTrivialMove()) {
+    // Move files to the output level
+    int64_t bytes = 0;
+    for (int i = 0; i < c->num_input_files(0); i++) {
+      FileMetaData* f = c->input(0, i);
+      c->edit()->DeleteFile(c->level(), f->number);
+      c->edit()->AddFile(c->output_level(), *f);
+      bytes += f->file_size;
+    }
+    status = versions_->LogAndApply(c->edit(), &mutex_);
+    if (status.ok()) {
+      CompactionStats stats;
+      stats.moves = 1;
+      stats.bytes_moved = bytes;
+      stats_[c->output_level()].Add(stats);
+    } else {
+      RecordBackgroundError(status);
+    }
+    VersionSet::LevelSummaryStorage tmp;
+    Log(options_.info_log, "Moved %d@%d files to level-%d %lld bytes %s: %s\n",
+        c->num_input_files(0), c->level(), c->output_level(),
+        static_cast<long long>(bytes), status.ToString().c_str(),
+        versions_->LevelSummary(&tmp));
   } else {
+    compactions_by_reason_[c->reason()]++;
     CompactionState* compact = new CompactionState(c);
+    compact->is_manual = is_manual;
     status = DoCompactionWork(compact);
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -796,6 +906,10 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.smallest_seqno = kMaxSequenceNumber;
+    out.largest_seqno = 0;
+    out.num_entries = 0;
+    out.num_deletions = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -822,6 +936,9 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
   if (s.ok()) {
+    const CompactionState::Output* out = compact->current_output();
+    compact->builder->SetInternalKeyProperties(
+        out->num_deletions, out->smallest_seqno, out->largest_seqno);
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
@@ -858,20 +975,137 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   return s;
 }
 
+Status DBImpl::AddCompactionOutput(CompactionState* compact, const Slice& key,
+                                   const Slice& value, Iterator* input) {
+  // Open output file if necessary
+  if (compact->builder == nullptr) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  CompactionState::Output* out = compact->current_output();
+  if (compact->builder->NumEntries() == 0) {
+    out->smallest.DecodeFrom(key);
+  }
+  out->largest.DecodeFrom(key);
+  ParsedInternalKey ikey;
+  if (ParseInternalKey(key, &ikey)) {
+    out->smallest_seqno = std::min(out->smallest_seqno, ikey.sequence);
+    out->largest_seqno = std::max(out->largest_seqno, ikey.sequence);
+    if (ikey.type == kTypeDeletion) {
+      out->num_deletions++;
+    }
+  }
+  out->num_entries++;
+  compact->builder->Add(key, value);
+
+  // Close output file if it is big enough
+  if (compact->builder->FileSize() >=
+      compact->compaction->MaxOutputFileSize()) {
+    return FinishCompactionOutputFile(compact, input);
+  }
+  return Status::OK();
+}
+
+Status DBImpl::CompactMergeOperands(CompactionState* compact, Iterator* input,
+                                    const Slice& user_key,
+                                    SequenceNumber sequence) {
+  // Collect the operands for user_key, newest first, up to the value or
+  // deletion they apply to.  That entry is left for the caller, which
+  // drops it as hidden by the entry written here.
+  std::vector<std::string> operands;
+  std::vector<SequenceNumber> sequences;
+  Slice existing_value;
+  bool has_existing_value = false;
+  bool found_base = false;
+  for (; input->Valid(); input->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(input->key(), &ikey) ||
+        user_comparator()->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(input->value().ToString());
+      sequences.push_back(ikey.sequence);
+      continue;
+    }
+    found_base = true;
+    if (ikey.type == kTypeValue) {
+      existing_value = input->value();
+      has_existing_value = true;
+    }
+    break;
+  }
+  assert(!operands.empty() && sequences[0] == sequence);
+  // The caller counted the first operand and will count the base entry.
+  compact->num_input_records += operands.size() - 1;
+
+  const MergeOperator* merge_operator = options_.merge_operator;
+  assert(merge_operator != nullptr);
+  std::string merged;
+  if (found_base || compact->compaction->IsBaseLevelForKey(user_key)) {
+    // The operands can be applied now, producing a plain value.
+    Status s = ApplyMergeOperands(merge_operator, user_key,
+                                  has_existing_value ? &existing_value : nullptr,
+                                  operands, &merged);
+    if (!s.ok()) {
+      return s;
+    }
+    InternalKey result(user_key, sequence, kTypeValue);
+    return AddCompactionOutput(compact, result.Encode(), merged, input);
+  }
+
+  // The value lives in a deeper level.  Shorten the chain if the
+  // operator can combine operands on their own.
+  merged = operands.back();
+  bool combined = true;
+  for (size_t i = operands.size() - 1; combined && i > 0; i--) {
+    std::string partial;
+    combined = merge_operator->PartialMerge(user_key, merged, operands[i - 1],
+                                            &partial);
+    merged.swap(partial);
+  }
+  if (combined) {
+    operands.assign(1, merged);
+    sequences.resize(1);
+  }
+  for (size_t i = 0; i < operands.size(); i++) {
+    InternalKey operand(user_key, sequences[i], kTypeMerge);
+    Status s = AddCompactionOutput(compact, operand.Encode(), operands[i], input);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
 Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(1),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    if (out.largest_seqno != 0) {
+      f.smallest_seqno = out.smallest_seqno;
+      f.largest_seqno = out.largest_seqno;
+    }
+    f.creation_time = compact->compaction->OldestCreationTime();
+    f.num_entries = out.num_entries;
+    f.num_deletions = out.num_deletions;
+    compact->compaction->edit()->AddFile(level, f);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
@@ -880,10 +1114,11 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
   int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
+  Log(options_.info_log, "Compacting %d@%d + %d@%d files (%s)",
       compact->compaction->num_input_files(0), compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level(),
+      kCompactionReasonNames[compact->compaction->reason()]);
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
@@ -904,12 +1139,19 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  const CompactionFilter* filter = options_.compaction_filter;
+  CompactionFilter::Context filter_context;
+  filter_context.level = compact->compaction->level();
+  filter_context.output_level = compact->compaction->output_level();
+  filter_context.is_manual_compaction = compact->is_manual;
+  std::string filtered_key;    // Deletion marker for a removed entry
+  std::string filtered_value;  // Value supplied by the filter
   for (; input->Valid() && !shutting_down_.load(std::memory_order_acquire);) {
     // Prioritize immutable compaction work
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (!imm_.empty()) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
@@ -919,7 +1161,11 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    Slice value = input->value();
+    compact->num_input_records++;
+    if (compact->compaction->ShouldStopBefore(
+            key, compact->builder != nullptr ? compact->builder->FileSize()
+                                             : 0) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -958,9 +1204,52 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (ikey.type == kTypeMerge &&
+                 ikey.sequence <= compact->smallest_snapshot &&
+                 options_.merge_operator != nullptr) {
+        // Every reader sees this operand and the older entries for the
+        // key, so they can be combined.  This consumes the operands and
+        // leaves input at the next entry to process.  Without an operator
+        // the operands and what they apply to are kept as they are.
+        status = CompactMergeOperands(compact, input, current_user_key,
+                                      ikey.sequence);
+        if (!status.ok()) {
+          break;
+        }
+        last_sequence_for_key = ikey.sequence;
+        continue;
+      } else if (filter != nullptr && ikey.type == kTypeValue &&
+                 ikey.sequence <= compact->smallest_snapshot) {
+        // Every reader sees this entry, so let the filter rewrite it.
+        filtered_value.clear();
+        switch (filter->Filter(filter_context, ikey.user_key, value,
+                               &filtered_value)) {
+          case CompactionFilter::kKeep:
+            break;
+          case CompactionFilter::kChangeValue:
+            value = filtered_value;
+            break;
+          case CompactionFilter::kRemove:
+            if (compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+              drop = true;
+            } else {
+              // Older values in higher levels must stay hidden, so
+              // replace the entry with a deletion marker.
+              filtered_key.clear();
+              AppendInternalKey(&filtered_key,
+                                ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                  kTypeDeletion));
+              key = filtered_key;
+              value = Slice();
+            }
+            break;
+        }
       }
 
-      last_sequence_for_key = ikey.sequence;
+      if (ikey.type != kTypeMerge) {
+        // Operands left in place do not hide the entries they apply to
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -973,26 +1262,9 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #endif
 
     if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+      status = AddCompactionOutput(compact, key, value, input);
+      if (!status.ok()) {
+        break;
       }
     }
 
@@ -1012,18 +1284,26 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   input = nullptr;
 
   CompactionStats stats;
+  stats.count = 1;
   stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  const Compaction* c = compact->compaction;
   for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      const int64_t bytes = c->input(which, i)->file_size;
+      stats.bytes_read += bytes;
+      if (which == 1 || c->level() == c->output_level()) {
+        stats.bytes_read_output_level += bytes;
+      }
     }
   }
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     stats.bytes_written += compact->outputs[i].file_size;
+    stats.output_records += compact->outputs[i].num_entries;
   }
+  stats.input_records = compact->num_input_records;
 
   mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+  stats_[compact->compaction->output_level()].Add(stats);
 
   if (status.ok()) {
     status = InstallCompactionResults(compact);
@@ -1042,9 +1322,10 @@ struct IterState {
   port::Mutex* const mu;
   Version* const version GUARDED_BY(mu);
   MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+  const std::vector<MemTable*> imm GUARDED_BY(mu);
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
+  IterState(port::Mutex* mutex, MemTable* mem,
+            const std::vector<MemTable*>& imm, Version* version)
       : mu(mutex), version(version), mem(mem), imm(imm) {}
 };
 
@@ -1052,7 +1333,9 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
   state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
+  for (MemTable* imm : state->imm) {
+    imm->Unref();
+  }
   state->version->Unref();
   state->mu->Unlock();
   delete state;
@@ -1065,28 +1348,42 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       uint32_t* seed) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
+  Iterator* internal_iter =
+      NewInternalIterator(options, config::kNumLevels - 1);
+  *seed = ++seed_;
+  mutex_.Unlock();
+  return internal_iter;
+}
+
+Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
+                                      int last_level) {
+  mutex_.AssertHeld();
 
   // Collect together all needed child iterators
   std::vector<Iterator*> list;
   list.push_back(mem_->NewIterator());
   mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  for (MemTable* imm : imm_) {
+    list.push_back(imm->NewIterator());
+    imm->Ref();
   }
-  versions_->current()->AddIterators(options, &list);
+  versions_->current()->AddIterators(options, 0, last_level, &list);
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
   IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
-
-  *seed = ++seed_;
-  mutex_.Unlock();
   return internal_iter;
 }
 
+const SliceTransform* DBImpl::IteratorPrefixExtractor(
+    const ReadOptions& options) const {
+  return (options.prefix_same_as_start && options_.prefix_extractor != nullptr)
+             ? internal_prefix_extractor_.user_transform()
+             : nullptr;
+}
+
 Iterator* DBImpl::TEST_NewInternalIterator() {
   SequenceNumber ignored;
   uint32_t ignored_seed;
@@ -1098,8 +1395,33 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+static void UnrefMemTable(void* arg1, void* arg2) {
+  port::Mutex* mu = reinterpret_cast<port::Mutex*>(arg1);
+  MemTable* mem = reinterpret_cast<MemTable*>(arg2);
+  mu->Lock();
+  mem->Unref();
+  mu->Unlock();
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  // Values that are not pinned are built in *value directly
+  PinnableSlice pinnable(value);
+  Status s = GetImpl(options, key, &pinnable, false);
+  if (s.ok() && pinnable.IsPinned()) {
+    value->assign(pinnable.data(), pinnable.size());
+  }
+  return s;
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  return GetImpl(options, key, value, true);
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options, const Slice& key,
+                       PinnableSlice* value, bool pin_memtable_value) {
+  value->Reset();
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1111,50 +1433,99 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   }
 
   MemTable* mem = mem_;
-  MemTable* imm = imm_;
+  std::vector<MemTable*> imm = imm_;
   Version* current = versions_->current();
   mem->Ref();
-  if (imm != nullptr) imm->Ref();
+  for (MemTable* m : imm) {
+    m->Ref();
+  }
   current->Ref();
 
   bool have_stat_update = false;
   Version::GetStats stats;
+  MemTable* value_mem = nullptr;  // Memtable that holds the value found
+  Slice mem_value;
 
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
-    // First look in the memtable, then in the immutable memtable (if any).
+    // First look in the memtable, then in the immutable memtables (if any)
+    // from newest to oldest.
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
-    } else {
-      s = current->Get(options, lkey, value, &stats);
+    std::vector<std::string> merge_operands;
+    bool done = mem->Get(lkey, &mem_value, &s, &merge_operands);
+    if (done) {
+      value_mem = mem;
+    }
+    for (size_t i = imm.size(); !done && i > 0; i--) {
+      done = imm[i - 1]->Get(lkey, &mem_value, &s, &merge_operands);
+      if (done) {
+        value_mem = imm[i - 1];
+      }
+    }
+    if (!done) {
+      // Pins the value it finds in *value
+      s = current->Get(options, lkey, value, &stats, &merge_operands);
       have_stat_update = true;
     }
+    if (!s.ok()) {
+      value_mem = nullptr;
+    }
+    if (!merge_operands.empty() && (s.ok() || s.IsNotFound())) {
+      // Apply the operands to the value found below them, if any
+      Slice existing = (value_mem != nullptr) ? mem_value : Slice(*value);
+      s = ApplyMergeOperands(options_.merge_operator, key,
+                             s.ok() ? &existing : nullptr, merge_operands,
+                             value->GetSelf());
+      value_mem = nullptr;
+      if (s.ok()) {
+        value->PinSelf();
+      }
+    }
+    if (!s.ok()) {
+      value->Reset();
+    }
+    if (value_mem != nullptr && !pin_memtable_value) {
+      // Copy while the memtable is still referenced: releasing a pinned
+      // value would have to lock mutex_ again.
+      value->PinSelf(mem_value);
+      value_mem = nullptr;
+    }
     mutex_.Lock();
   }
 
+  if (value_mem != nullptr) {
+    // Keep the memtable, and with it the value, alive for *value
+    value_mem->Ref();
+    value->PinSlice(mem_value, &UnrefMemTable, &mutex_, value_mem);
+  }
   if (have_stat_update && current->UpdateStats(stats)) {
     MaybeScheduleCompaction();
   }
   mem->Unref();
-  if (imm != nullptr) imm->Unref();
+  for (MemTable* m : imm) {
+    m->Unref();
+  }
   current->Unref();
   return s;
 }
 
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
+  if (options.tailing) {
+    return NewTailingIterator(this, options);
+  }
   SequenceNumber latest_snapshot;
   uint32_t seed;
   Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  return NewDBIterator(this, user_comparator(), options_.merge_operator,
+                       IteratorPrefixExtractor(options),
+                       options.iterate_lower_bound,
+                       options.iterate_upper_bound, iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       options_.read_sampling_period, seed);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1183,10 +1554,19 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == nullptr) {
+    return Status::NotSupported("no merge operator configured");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
+  w.manual_wal_flush = options.manual_wal_flush;
   w.done = false;
 
   MutexLock l(&mutex_);
@@ -1198,12 +1578,19 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     return w.status;
   }
 
-  // May temporarily unlock and wait.
-  Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  // Group the writes first so that any delay is in proportion to all of
+  // them.  MakeRoomForWrite() may temporarily unlock and wait.
   Writer* last_writer = &w;
-  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* updates = BuildBatchGroup(&last_writer);
+  WriteBatch* group = nullptr;  // nullptr batch is for compactions
+  if (updates != nullptr) {
+    group = BuildBatchGroup(&last_writer);
+  }
+  Status status = MakeRoomForWrite(
+      updates == nullptr,
+      group != nullptr ? WriteBatchInternal::ByteSize(group) : 0);
+  uint64_t last_sequence = versions_->LastSequence();
+  if (status.ok() && group != nullptr) {
+    WriteBatch* updates = group;
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(updates);
 
@@ -1213,7 +1600,8 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     // into mem_.
     {
       mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(updates));
+      status = log_->AddRecord(WriteBatchInternal::Contents(updates),
+                               !options.manual_wal_flush);
       bool sync_error = false;
       if (status.ok() && options.sync) {
         status = logfile_->Sync();
@@ -1232,10 +1620,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
-    if (updates == tmp_batch_) tmp_batch_->Clear();
-
     versions_->SetLastSequence(last_sequence);
   }
+  if (group == tmp_batch_) tmp_batch_->Clear();
 
   while (true) {
     Writer* ready = writers_.front();
@@ -1256,6 +1643,215 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+Status DBImpl::FlushWAL(bool sync) {
+  // Queue up like a write so that we have exclusive access to the log.
+  // If a preceding write group absorbs this request, its own flush (and
+  // sync, if requested) covers everything buffered so far.
+  Writer w(&mutex_);
+  w.sync = sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  while (!w.done && &w != writers_.front()) {
+    w.cv.Wait();
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  Status status = bg_error_;
+  if (status.ok()) {
+    mutex_.Unlock();
+    status = sync ? logfile_->Sync() : logfile_->Flush();
+    mutex_.Lock();
+    if (!status.ok()) {
+      // As in Write(), the contents of the log are now indeterminate.
+      RecordBackgroundError(status);
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return status;
+}
+
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  char space[8192];
+  while (s.ok()) {
+    Slice fragment;
+    s = in->Read(sizeof(space), &fragment, space);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+  }
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->DeleteFile(dst);
+  }
+  return s;
+}
+
+bool DBImpl::MemTableOverlaps(const Slice& smallest_user_key,
+                              const Slice& largest_user_key) {
+  mutex_.AssertHeld();
+  InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  Iterator* iter = mem_->NewIterator();
+  iter->Seek(start.Encode());
+  const bool overlaps =
+      iter->Valid() && user_comparator()->Compare(ExtractUserKey(iter->key()),
+                                                  largest_user_key) <= 0;
+  delete iter;
+  return overlaps;
+}
+
+Status DBImpl::IngestExternalFile(const IngestExternalFileOptions& options,
+                                  const std::string& fname) {
+  uint64_t file_size;
+  Status s = env_->GetFileSize(fname, &file_size);
+  if (!s.ok()) {
+    return s;
+  }
+
+  uint64_t number;
+  {
+    MutexLock l(&mutex_);
+    number = versions_->NewFileNumber();
+    pending_outputs_.insert(number);
+  }
+
+  // Bring the file into the database directory and find its key range.
+  const std::string table_name = TableFileName(dbname_, number);
+  if (options.move_files) {
+    s = env_->RenameFile(fname, table_name);
+  } else {
+    s = CopyFile(env_, fname, table_name);
+  }
+  const bool added = s.ok();
+  std::string smallest, largest;
+  ValueType smallest_type = kTypeValue, largest_type = kTypeValue;
+  if (s.ok()) {
+    Iterator* iter =
+        table_cache_->NewIterator(ReadOptions(), number, file_size);
+    ParsedInternalKey first, last;
+    iter->SeekToFirst();
+    if (iter->Valid() && ParseInternalKey(iter->key(), &first)) {
+      smallest = first.user_key.ToString();
+      smallest_type = first.type;
+      iter->SeekToLast();
+      if (iter->Valid() && ParseInternalKey(iter->key(), &last)) {
+        largest = last.user_key.ToString();
+        largest_type = last.type;
+      }
+    }
+    s = iter->status();
+    if (s.ok() && !iter->Valid()) {
+      s = Status::InvalidArgument(fname, "empty or unreadable table");
+    } else if (s.ok() && (first.sequence != 0 || last.sequence != 0)) {
+      s = Status::InvalidArgument(fname, "not written by SstFileWriter");
+    }
+    delete iter;
+  }
+
+  MutexLock l(&mutex_);
+  int level = 0;
+  if (s.ok()) {
+    // Queue up like a write so that no write can be assigned a sequence
+    // number while the file is being added.
+    Writer w(&mutex_);
+    w.exclusive = true;
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+      w.cv.Wait();
+    }
+
+    // Entries already in the memtable for the file's key range are older
+    // than the file and must reach the table files before it does.  Then
+    // let background work drain so that no compaction output lands next to
+    // the file.
+    if (MemTableOverlaps(smallest, largest)) {
+      s = MakeRoomForWrite(true /* force */, 0);
+    }
+    ingesting_ = true;
+    if (s.ok()) {
+      // Background work stops after an error and would never drain.
+      s = bg_error_;
+    }
+    while (s.ok() && (background_compaction_scheduled_ || !imm_.empty())) {
+      background_work_finished_signal_.Wait();
+      s = bg_error_;
+    }
+
+    if (s.ok()) {
+      const SequenceNumber seqno = versions_->LastSequence() + 1;
+      versions_->SetLastSequence(seqno);
+
+      Version* base = versions_->current();
+      base->Ref();
+      level = base->PickLevelForExternalFile(smallest, largest);
+      base->Unref();
+
+      FileMetaData f;
+      f.number = number;
+      f.file_size = file_size;
+      f.smallest.SetFrom(ParsedInternalKey(smallest, seqno, smallest_type));
+      f.largest.SetFrom(ParsedInternalKey(largest, seqno, largest_type));
+      f.smallest_seqno = seqno;
+      f.largest_seqno = seqno;
+      f.global_seqno = seqno;
+      f.creation_time = env_->NowMicros() / 1000000;
+
+      VersionEdit edit;
+      edit.AddFile(level, f);
+      s = versions_->LogAndApply(&edit, &mutex_);
+    }
+    ingesting_ = false;
+    MaybeScheduleCompaction();
+
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+  }
+  pending_outputs_.erase(number);
+
+  if (s.ok()) {
+    Log(options_.info_log, "Ingested #%llu at level-%d: %lld bytes",
+        static_cast<unsigned long long>(number), level,
+        static_cast<long long>(file_size));
+  } else if (added) {
+    table_cache_->Evict(number);
+    if (options.move_files) {
+      env_->RenameFile(table_name, fname);
+    } else {
+      env_->DeleteFile(table_name);
+    }
+  }
+  return s;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
 WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
@@ -1280,11 +1876,22 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   ++iter;  // Advance past "first"
   for (; iter != writers_.end(); ++iter) {
     Writer* w = *iter;
+    if (w->exclusive) {
+      // Let the writer run on its own.
+      break;
+    }
+
     if (w->sync && !first->sync) {
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
     }
 
+    if (!w->manual_wal_flush && first->manual_wal_flush) {
+      // Do not include a write that must reach the operating system into
+      // a batch that is only buffered.
+      break;
+    }
+
     if (w->batch != nullptr) {
       size += WriteBatchInternal::ByteSize(w->batch);
       if (size > max_size) {
@@ -1306,49 +1913,141 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   return result;
 }
 
+Status DBImpl::NewLogFile(uint64_t log_number, WritableFile** file,
+                          log::Writer** writer) {
+  mutex_.AssertHeld();
+  const std::string fname = LogFileName(dbname_, log_number);
+  Status s;
+  if (!log_recycle_files_.empty()) {
+    const uint64_t old_number = log_recycle_files_.front();
+    log_recycle_files_.pop_front();
+    Log(options_.info_log, "Reusing log #%llu as #%llu\n",
+        static_cast<unsigned long long>(old_number),
+        static_cast<unsigned long long>(log_number));
+    s = env_->ReuseWritableFile(fname, LogFileName(dbname_, old_number), file);
+  } else {
+    s = env_->NewWritableFile(fname, file);
+    if (s.ok()) {
+      // The log will hold roughly one memtable's worth of updates.
+      // Preallocation is only a hint, so errors are ignored.
+      (*file)->Preallocate(options_.write_buffer_size);
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  uint64_t recyclable_number = 0;
+  if (options_.recycle_log_file_num > 0) {
+    recyclable_number = log_number;
+    if (min_recyclable_log_number_ == 0) {
+      min_recyclable_log_number_ = log_number;
+    }
+  }
+  *writer = new log::Writer(*file, options_.wal_compression, recyclable_number);
+  return s;
+}
+
+uint64_t DBImpl::WriteDelayMicros(size_t bytes, WriteStallCause* cause) {
+  mutex_.AssertHeld();
+  // FIFO compaction never merges level-0 files, so their number is no
+  // sign of compactions falling behind.
+  const int level0_files = options_.compaction_style == kCompactionStyleFIFO
+                               ? 0
+                               : versions_->NumLevelFiles(0);
+  const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+  const uint64_t limit = options_.soft_pending_compaction_bytes_limit;
+  double rate = options_.delayed_write_rate;
+  if (level0_files >= config::kL0_SlowdownWritesTrigger) {
+    // Slow down further with every file that brings us closer to the
+    // point where writes stop completely.
+    const int room = config::kL0_StopWritesTrigger - level0_files;
+    if (room > 0) {
+      rate *= static_cast<double>(room) /
+              (config::kL0_StopWritesTrigger - config::kL0_SlowdownWritesTrigger);
+    }
+    *cause = kStallLevel0Slowdown;
+  } else if (limit > 0 && pending_bytes > limit) {
+    *cause = kStallPendingCompactionSlowdown;
+  } else {
+    // Compactions are keeping up; do not carry a debt into the future.
+    next_write_micros_ = 0;
+    return 0;
+  }
+  if (limit > 0 && pending_bytes > limit) {
+    rate *= std::max(static_cast<double>(limit) / pending_bytes, 0.125);
+  }
+
+  // Admit writes at "rate" bytes per second: each write pushes back the
+  // time at which the next one may complete.
+  const uint64_t now = env_->NowMicros();
+  if (next_write_micros_ < now) {
+    next_write_micros_ = now;
+  }
+  next_write_micros_ += static_cast<uint64_t>(bytes * 1e6 / rate);
+  return next_write_micros_ - now;
+}
+
+void DBImpl::RecordWriteStall(WriteStallCause cause, uint64_t micros) {
+  mutex_.AssertHeld();
+  write_stalls_[cause].count++;
+  write_stalls_[cause].micros += micros;
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
-Status DBImpl::MakeRoomForWrite(bool force) {
+Status DBImpl::MakeRoomForWrite(bool force, size_t write_bytes) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  WriteStallCause cause;
+  uint64_t delay;
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay &&
+               (delay = WriteDelayMicros(write_bytes, &cause)) > 0) {
       // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
+      // L0 files, or compactions are falling behind.  Rather than
+      // delaying a single write by several seconds when we hit the hard
+      // limit, delay each individual write in proportion to its size so
+      // that writes proceed at a rate compactions can sustain.  Also,
+      // this delay hands over some CPU to the compaction thread in case
+      // it is sharing the same core as the writer.
       mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
+      env_->SleepForMicroseconds(static_cast<int>(delay));
       mutex_.Lock();
+      allow_delay = false;  // Do not delay a single write more than once
+      RecordWriteStall(cause, delay);
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       break;
-    } else if (imm_ != nullptr) {
+    } else if (imm_.size() + 1 >=
+               static_cast<size_t>(options_.max_write_buffer_number)) {
       // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+      // ones are still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      RecordWriteStall(kStallMemtableLimit, env_->NowMicros() - start_micros);
+    } else if (options_.compaction_style != kCompactionStyleFIFO &&
+               versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
+      const uint64_t start_micros = env_->NowMicros();
       background_work_finished_signal_.Wait();
+      RecordWriteStall(kStallLevel0Stop, env_->NowMicros() - start_micros);
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
       uint64_t new_log_number = versions_->NewFileNumber();
       WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
+      log::Writer* new_log = nullptr;
+      s = NewLogFile(new_log_number, &lfile, &new_log);
       if (!s.ok()) {
         // Avoid chewing through file number space in a tight loop.
         versions_->ReuseFileNumber(new_log_number);
@@ -1358,8 +2057,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       delete logfile_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
-      imm_ = mem_;
+      log_ = new_log;
+      imm_.push_back(mem_);
+      imm_log_numbers_.push_back(new_log_number);
       has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
@@ -1370,7 +2070,29 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+void DBImpl::AppendStatsRow(const char* label, int files, int64_t bytes,
+                            const CompactionStats& stats, int64_t bytes_in,
+                            std::string* value) {
+  const double read_amp =
+      bytes_in > 0 ? static_cast<double>(stats.bytes_read) / bytes_in : 0.0;
+  const double write_amp =
+      bytes_in > 0 ? static_cast<double>(stats.bytes_written) / bytes_in : 0.0;
+  char buf[200];
+  snprintf(buf, sizeof(buf),
+           "%3s %8d %8.0f %9.0f %8.0f %9.0f %5lld %9.0f %5.1f %5.1f %6.0f "
+           "%7.0f\n",
+           label, files, bytes / 1048576.0, stats.micros / 1e6,
+           stats.bytes_read / 1048576.0, stats.bytes_written / 1048576.0,
+           static_cast<long long>(stats.count), stats.bytes_moved / 1048576.0,
+           read_amp, write_amp, stats.input_records / 1000.0,
+           (stats.input_records - stats.output_records) / 1000.0);
+  value->append(buf);
+}
+
 bool DBImpl::GetProperty(const Slice& property, std::string* value) {
+  static const char* const kStallCauseNames[kNumWriteStallCauses] = {
+      "level0-slowdown", "pending-compaction-slowdown", "memtable-limit",
+      "level0-stop"};
   value->clear();
 
   MutexLock l(&mutex_);
@@ -1393,34 +2115,189 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       return true;
     }
   } else if (in == "stats") {
-    char buf[200];
+    char buf[300];
     snprintf(buf, sizeof(buf),
              "                               Compactions\n"
-             "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
-             "--------------------------------------------------\n");
+             "Level  Files Size(MB) Time(sec) Read(MB) Write(MB) Count "
+             "Moved(MB) R-Amp W-Amp  In(K) Drop(K)\n"
+             "---------------------------------------------------------"
+             "-------------------------------------\n");
     value->append(buf);
+    CompactionStats sum;
+    int total_files = 0;
+    int64_t total_bytes = 0;
     for (int level = 0; level < config::kNumLevels; level++) {
       int files = versions_->NumLevelFiles(level);
-      if (stats_[level].micros > 0 || files > 0) {
-        snprintf(buf, sizeof(buf), "%3d %8d %8.0f %9.0f %8.0f %9.0f\n", level,
-                 files, versions_->NumLevelBytes(level) / 1048576.0,
-                 stats_[level].micros / 1e6,
-                 stats_[level].bytes_read / 1048576.0,
-                 stats_[level].bytes_written / 1048576.0);
-        value->append(buf);
+      int64_t bytes = versions_->NumLevelBytes(level);
+      const CompactionStats& stats = stats_[level];
+      if (stats.count > 0 || stats.moves > 0 || files > 0) {
+        snprintf(buf, sizeof(buf), "%3d", level);
+        AppendStatsRow(buf, files, bytes, stats, stats.bytes_in(), value);
       }
+      sum.Add(stats);
+      total_files += files;
+      total_bytes += bytes;
+    }
+    // Amplification of the whole tree is relative to the data that
+    // entered it through memtables.
+    AppendStatsRow("Sum", total_files, total_bytes, sum, sum.bytes_flushed,
+                   value);
+    CompactionStats interval = sum;
+    interval.Subtract(last_reported_stats_);
+    AppendStatsRow("Int", total_files, total_bytes, interval,
+                   interval.bytes_flushed, value);
+    const uint64_t now_micros = env_->NowMicros();
+    snprintf(buf, sizeof(buf), "Interval: %.1f seconds\n",
+             (now_micros - last_reported_micros_) / 1e6);
+    value->append(buf);
+    last_reported_stats_ = sum;
+    last_reported_micros_ = now_micros;
+
+    value->append("Compactions by reason:");
+    for (int i = 0; i < kNumCompactionReasons; i++) {
+      snprintf(buf, sizeof(buf), " %s=%lld", kCompactionReasonNames[i],
+               static_cast<long long>(compactions_by_reason_[i]));
+      value->append(buf);
+    }
+    snprintf(buf, sizeof(buf), " trivial-move=%lld\n",
+             static_cast<long long>(sum.moves));
+    value->append(buf);
+    value->append("Stalls(sec):");
+    for (int i = 0; i < kNumWriteStallCauses; i++) {
+      snprintf(buf, sizeof(buf), " %s=%.3f", kStallCauseNames[i],
+               write_stalls_[i].micros / 1e6);
+      value->append(buf);
+    }
+    value->append("\n");
+    return true;
+  } else if (in == "compaction-stats") {
+    char buf[200];
+    CompactionStats sum;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      const CompactionStats& stats = stats_[level];
+      snprintf(buf, sizeof(buf),
+               "L%d.files=%d\n"
+               "L%d.size_bytes=%lld\n",
+               level, versions_->NumLevelFiles(level), level,
+               static_cast<long long>(versions_->NumLevelBytes(level)));
+      value->append(buf);
+      snprintf(buf, sizeof(buf),
+               "L%d.compactions=%lld\n"
+               "L%d.micros=%lld\n"
+               "L%d.read_bytes=%lld\n"
+               "L%d.read_output_level_bytes=%lld\n",
+               level, static_cast<long long>(stats.count), level,
+               static_cast<long long>(stats.micros), level,
+               static_cast<long long>(stats.bytes_read), level,
+               static_cast<long long>(stats.bytes_read_output_level));
+      value->append(buf);
+      snprintf(buf, sizeof(buf),
+               "L%d.write_bytes=%lld\n"
+               "L%d.flush_bytes=%lld\n"
+               "L%d.moves=%lld\n"
+               "L%d.moved_bytes=%lld\n",
+               level, static_cast<long long>(stats.bytes_written), level,
+               static_cast<long long>(stats.bytes_flushed), level,
+               static_cast<long long>(stats.moves), level,
+               static_cast<long long>(stats.bytes_moved));
+      value->append(buf);
+      snprintf(buf, sizeof(buf),
+               "L%d.input_records=%lld\n"
+               "L%d.dropped_records=%lld\n",
+               level, static_cast<long long>(stats.input_records), level,
+               static_cast<long long>(stats.input_records -
+                                      stats.output_records));
+      value->append(buf);
+      sum.Add(stats);
+    }
+    snprintf(buf, sizeof(buf),
+             "sum.read_bytes=%lld\n"
+             "sum.write_bytes=%lld\n"
+             "sum.flush_bytes=%lld\n"
+             "sum.write_amp=%.3f\n",
+             static_cast<long long>(sum.bytes_read),
+             static_cast<long long>(sum.bytes_written),
+             static_cast<long long>(sum.bytes_flushed),
+             sum.bytes_flushed > 0
+                 ? static_cast<double>(sum.bytes_written) / sum.bytes_flushed
+                 : 0.0);
+    value->append(buf);
+    for (int i = 0; i < kNumCompactionReasons; i++) {
+      snprintf(buf, sizeof(buf), "reason.%s=%lld\n",
+               kCompactionReasonNames[i],
+               static_cast<long long>(compactions_by_reason_[i]));
+      value->append(buf);
+    }
+    snprintf(buf, sizeof(buf), "reason.trivial-move=%lld\n",
+             static_cast<long long>(sum.moves));
+    value->append(buf);
+    for (int i = 0; i < kNumWriteStallCauses; i++) {
+      snprintf(buf, sizeof(buf),
+               "stall.%s.count=%lld\n"
+               "stall.%s.micros=%lld\n",
+               kStallCauseNames[i],
+               static_cast<long long>(write_stalls_[i].count),
+               kStallCauseNames[i],
+               static_cast<long long>(write_stalls_[i].micros));
+      value->append(buf);
+    }
+    return true;
+  } else if (in == "table-bytes-written") {
+    int64_t bytes_written = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      bytes_written += stats_[level].bytes_written;
+    }
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(bytes_written));
+    value->append(buf);
+    return true;
+  } else if (in == "write-stalls") {
+    char buf[200];
+    snprintf(buf, sizeof(buf),
+             "                     Write stalls\n"
+             "Cause                       Count Time(sec)\n"
+             "--------------------------------------------\n");
+    value->append(buf);
+    for (int i = 0; i < kNumWriteStallCauses; i++) {
+      snprintf(buf, sizeof(buf), "%-27s %5lld %9.3f\n", kStallCauseNames[i],
+               static_cast<long long>(write_stalls_[i].count),
+               write_stalls_[i].micros / 1e6);
+      value->append(buf);
     }
     return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
+  } else if (in == "table-properties") {
+    Version* current = versions_->current();
+    current->Ref();
+    std::vector<FileMetaData*> files[config::kNumLevels];
+    for (int level = 0; level < config::kNumLevels; level++) {
+      current->GetOverlappingInputs(level, nullptr, nullptr, &files[level]);
+    }
+    // Reading the properties may open tables
+    mutex_.Unlock();
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : files[level]) {
+        char buf[100];
+        snprintf(buf, sizeof(buf), "--- level %d, table #%llu ---\n", level,
+                 static_cast<unsigned long long>(f->number));
+        value->append(buf);
+        TableProperties props;
+        Status s = table_cache_->GetProperties(f->number, f->file_size, &props);
+        value->append(s.ok() ? props.ToString() : s.ToString() + "\n");
+      }
+    }
+    mutex_.Lock();
+    current->Unref();
+    return true;
   } else if (in == "approximate-memory-usage") {
     size_t total_usage = options_.block_cache->TotalCharge();
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (MemTable* imm : imm_) {
+      total_usage += imm->ApproximateMemoryUsage();
     }
     char buf[50];
     snprintf(buf, sizeof(buf), "%llu",
@@ -1470,6 +2347,54 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  Status s = Get(options, key, value->GetSelf());
+  if (s.ok()) {
+    value->PinSelf();
+  }
+  return s;
+}
+
+Status DB::GetValueSize(const ReadOptions& options, const Slice& key,
+                        uint64_t* size) {
+  PinnableSlice value;
+  Status s = Get(options, key, &value);
+  if (s.ok()) {
+    *size = value.size();
+  }
+  return s;
+}
+
+Status DB::KeyExists(const ReadOptions& options, const Slice& key) {
+  uint64_t size;
+  return GetValueSize(options, key, &size);
+}
+
+bool DB::KeyMayExist(const ReadOptions& options, const Slice& key,
+                     std::string* value, bool* value_found) {
+  ReadOptions memory_only = options;
+  memory_only.no_io = true;
+  PinnableSlice pinnable;
+  Status s = Get(memory_only, key, &pinnable);
+  if (value_found != nullptr) {
+    *value_found = s.ok();
+  }
+  if (s.ok() && value != nullptr) {
+    value->assign(pinnable.data(), pinnable.size());
+  }
+  // Errors, including reads that would have needed I/O, decide nothing
+  return !s.IsNotFound();
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1485,13 +2410,11 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
     // Create new log and a corresponding memtable.
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     WritableFile* lfile;
-    s = options.env->NewWritableFile(LogFileName(dbname, new_log_number),
-                                     &lfile);
+    s = impl->NewLogFile(new_log_number, &lfile, &impl->log_);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
-      impl->log_ = new log::Writer(lfile);
       impl->mem_ = new MemTable(impl->internal_comparator_);
       impl->mem_->Ref();
     }
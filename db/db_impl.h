@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/version_set.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -22,9 +24,6 @@ namespace leveldb {
 
 class MemTable;
 class TableCache;
-class Version;
-class VersionEdit;
-class VersionSet;
 
 class DBImpl : public DB {
  public:
@@ -39,15 +38,22 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status FlushWAL(bool sync) override;
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::string& fname) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -67,12 +73,13 @@ class DBImpl : public DB {
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
   // Record a sample of bytes read at the specified internal key.
-  // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.
+  // Samples are taken approximately once every
+  // Options::read_sampling_period bytes.
   void RecordReadSample(Slice key);
 
  private:
   friend class DB;
+  friend class TailingIterator;
   struct CompactionState;
   struct Writer;
 
@@ -88,23 +95,97 @@ class DBImpl : public DB {
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   struct CompactionStats {
-    CompactionStats() : micros(0), bytes_read(0), bytes_written(0) {}
+    CompactionStats()
+        : count(0),
+          micros(0),
+          bytes_read(0),
+          bytes_read_output_level(0),
+          bytes_written(0),
+          bytes_flushed(0),
+          moves(0),
+          bytes_moved(0),
+          input_records(0),
+          output_records(0) {}
 
     void Add(const CompactionStats& c) {
+      this->count += c.count;
       this->micros += c.micros;
       this->bytes_read += c.bytes_read;
+      this->bytes_read_output_level += c.bytes_read_output_level;
       this->bytes_written += c.bytes_written;
+      this->bytes_flushed += c.bytes_flushed;
+      this->moves += c.moves;
+      this->bytes_moved += c.bytes_moved;
+      this->input_records += c.input_records;
+      this->output_records += c.output_records;
+    }
+
+    void Subtract(const CompactionStats& c) {
+      this->count -= c.count;
+      this->micros -= c.micros;
+      this->bytes_read -= c.bytes_read;
+      this->bytes_read_output_level -= c.bytes_read_output_level;
+      this->bytes_written -= c.bytes_written;
+      this->bytes_flushed -= c.bytes_flushed;
+      this->moves -= c.moves;
+      this->bytes_moved -= c.bytes_moved;
+      this->input_records -= c.input_records;
+      this->output_records -= c.output_records;
     }
 
+    // Bytes of new data that entered the level: flushed memtables and
+    // the inputs of compactions from the level above.
+    int64_t bytes_in() const {
+      return bytes_flushed + bytes_read - bytes_read_output_level;
+    }
+
+    int64_t count;  // Memtable and background compactions, not moves
     int64_t micros;
     int64_t bytes_read;
+    int64_t bytes_read_output_level;  // Part of bytes_read from this level
     int64_t bytes_written;
+    int64_t bytes_flushed;  // Part of bytes_written from memtables
+    int64_t moves;          // Trivial moves of files into this level
+    int64_t bytes_moved;
+    int64_t input_records;   // Entries read by background compactions
+    int64_t output_records;  // Entries they wrote
+  };
+
+  // Reasons a write may be slowed down or stopped.
+  enum WriteStallCause {
+    kStallLevel0Slowdown,
+    kStallPendingCompactionSlowdown,
+    kStallMemtableLimit,
+    kStallLevel0Stop,
+    kNumWriteStallCauses
+  };
+
+  struct WriteStallStats {
+    WriteStallStats() : count(0), micros(0) {}
+
+    int64_t count;
+    int64_t micros;
   };
 
+  // Get() into *value.  Values found in a memtable are copied unless
+  // "pin_memtable_value" is set.
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 PinnableSlice* value, bool pin_memtable_value);
+
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
                                 uint32_t* seed);
 
+  // Returns an internal iterator over the memtables and the files in
+  // levels [0, last_level] of the current version.
+  Iterator* NewInternalIterator(const ReadOptions&, int last_level)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // The prefix extractor of iterators opened with "options", or nullptr
+  // if they are not in ReadOptions::prefix_same_as_start mode.
+  const SliceTransform* IteratorPrefixExtractor(
+      const ReadOptions& options) const;
+
   Status NewDB();
 
   // Recover the descriptor from persistent storage.  May do a significant
@@ -118,8 +199,8 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void DeleteObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
+  // Compact the immutable in-memory write buffers to disk.  Writes a new
+  // descriptor and drops the compacted buffers iff successful.
   // Errors are recorded in bg_error_.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -127,14 +208,42 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write the contents of "mems" into a single new level-0 table.
+  Status WriteLevel0Table(const std::vector<MemTable*>& mems,
+                          VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status MakeRoomForWrite(bool force /* compact even if there is room? */)
+  // Create log file "log_number", recycling an obsolete log file if one
+  // is available, and a log::Writer that writes to it.
+  Status NewLogFile(uint64_t log_number, WritableFile** file,
+                    log::Writer** writer) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Makes room in the memtable for a write of "write_bytes", delaying it
+  // first if compactions are falling behind.
+  Status MakeRoomForWrite(bool force /* compact even if there is room? */,
+                          size_t write_bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns how long a write of "bytes" should be delayed to keep the
+  // write rate sustainable for compactions, and sets *cause to the reason.
+  // Returns zero if the write need not be delayed.
+  uint64_t WriteDelayMicros(size_t bytes, WriteStallCause* cause)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void RecordWriteStall(WriteStallCause cause, uint64_t micros)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Append a row of the "leveldb.stats" table to *value.  Amplification
+  // is reported relative to "bytes_in".
+  static void AppendStatsRow(const char* label, int files, int64_t bytes,
+                             const CompactionStats& stats, int64_t bytes_in,
+                             std::string* value);
   WriteBatch* BuildBatchGroup(Writer** last_writer)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns true iff the current memtable holds an entry for a user key
+  // in [smallest_user_key,largest_user_key].
+  bool MemTableOverlaps(const Slice& smallest_user_key,
+                        const Slice& largest_user_key)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -148,6 +257,10 @@ class DBImpl : public DB {
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  Status AddCompactionOutput(CompactionState* compact, const Slice& key,
+                             const Slice& value, Iterator* input);
+  Status CompactMergeOperands(CompactionState* compact, Iterator* input,
+                              const Slice& user_key, SequenceNumber sequence);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -159,6 +272,7 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -175,13 +289,24 @@ class DBImpl : public DB {
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Memtables waiting to be compacted, oldest first.
+  std::vector<MemTable*> imm_ GUARDED_BY(mutex_);
+  // imm_log_numbers_[i] is the number of the log file that was started
+  // when imm_[i] stopped accepting writes.
+  std::vector<uint64_t> imm_log_numbers_ GUARDED_BY(mutex_);
+  std::atomic<bool> has_imm_;  // So bg thread can detect non-empty imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
 
+  // Obsolete log files kept around to be reused by NewLogFile().
+  std::deque<uint64_t> log_recycle_files_ GUARDED_BY(mutex_);
+  // Log files numbered at least this were written in the recyclable
+  // format by this process, so their leftovers can be told apart from
+  // new records.  Zero if no such log has been created yet.
+  uint64_t min_recyclable_log_number_ GUARDED_BY(mutex_);
+
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
@@ -197,12 +322,24 @@ class DBImpl : public DB {
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
+  // Is IngestExternalFile() waiting for background work to drain?  No new
+  // compactions are started meanwhile, although memtables are flushed.
+  bool ingesting_ GUARDED_BY(mutex_);
+
   VersionSet* const versions_;
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+  int64_t compactions_by_reason_[kNumCompactionReasons] GUARDED_BY(mutex_);
+  // Totals of stats_ when "leveldb.stats" was last read, and when.
+  CompactionStats last_reported_stats_ GUARDED_BY(mutex_);
+  uint64_t last_reported_micros_ GUARDED_BY(mutex_);
+
+  // Time before which delayed writes may not complete, in Env::NowMicros().
+  uint64_t next_write_micros_ GUARDED_BY(mutex_);
+  WriteStallStats write_stalls_[kNumWriteStallCauses] GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -210,6 +347,7 @@ class DBImpl : public DB {
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
                         const Options& src);
 
 }  // namespace leveldb
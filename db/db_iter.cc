@@ -4,9 +4,13 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -40,21 +44,37 @@ class DBIter : public Iterator {
  public:
   // Which direction is the iterator currently moving?
   // (1) When moving forward, the internal iterator is positioned at
-  //     the exact entry that yields this->key(), this->value()
+  //     the exact entry that yields this->key(), this->value(), unless
+  //     that entry was combined with merge operands (merged_ is set).  The
+  //     internal iterator is then positioned after the entries that were
+  //     combined.
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const Comparator* cmp, const MergeOperator* merge_operator,
+         const SliceTransform* prefix_extractor, const Slice* lower_bound,
+         const Slice* upper_bound, Iterator* iter, SequenceNumber s,
+         size_t read_sampling_period, uint32_t seed)
       : db_(db),
         user_comparator_(cmp),
+        merge_operator_(merge_operator),
+        prefix_extractor_(prefix_extractor),
         iter_(iter),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        prefix_bounded_(false),
+        has_lower_bound_(lower_bound != nullptr),
+        has_upper_bound_(upper_bound != nullptr),
+        read_sampling_period_(read_sampling_period),
         rnd_(seed),
-        bytes_until_read_sampling_(RandomCompactionPeriod()) {}
+        bytes_until_read_sampling_(
+            read_sampling_period > 0 ? RandomCompactionPeriod() : 0) {
+    if (has_lower_bound_) lower_bound_ = lower_bound->ToString();
+    if (has_upper_bound_) upper_bound_ = upper_bound->ToString();
+  }
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
@@ -63,11 +83,13 @@ class DBIter : public Iterator {
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ? iter_->value()
+                                                : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -84,14 +106,44 @@ class DBIter : public Iterator {
   void SeekToLast() override;
 
  private:
-  void FindNextUserEntry(bool skipping, std::string* skip);
+  void FindNextUserEntry(bool skipping, Slice* skip);
   void FindPrevUserEntry();
+  void MergeValuesForward();
   bool ParseKey(ParsedInternalKey* key);
+  void PrefixModeNotSupported(const char* operation);
+
+  bool BeforeLowerBound(const Slice& user_key) const {
+    return has_lower_bound_ &&
+           user_comparator_->Compare(user_key, lower_bound_) < 0;
+  }
+
+  bool AtOrAfterUpperBound(const Slice& user_key) const {
+    return has_upper_bound_ &&
+           user_comparator_->Compare(user_key, upper_bound_) >= 0;
+  }
+
+  // Does "user_key" have the prefix of the last Seek() target?
+  bool HasSeekPrefix(const Slice& user_key) const {
+    return prefix_extractor_->InDomain(user_key) &&
+           prefix_extractor_->Transform(user_key) == Slice(prefix_);
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
 
+  // Point *skip at "user_key", the user key of the current entry of
+  // iter_.  The key is only copied (into saved_key_) if iter_ does not
+  // keep it pinned.
+  inline void SetSkipKey(const Slice& user_key, Slice* skip) {
+    if (iter_->IsKeyPinned()) {
+      *skip = user_key;
+    } else {
+      SaveKey(user_key, &saved_key_);
+      *skip = saved_key_;
+    }
+  }
+
   inline void ClearSavedValue() {
     if (saved_value_.capacity() > 1048576) {
       std::string empty;
@@ -103,11 +155,13 @@ class DBIter : public Iterator {
 
   // Picks the number of bytes that can be read until a compaction is scheduled.
   size_t RandomCompactionPeriod() {
-    return rnd_.Uniform(2 * config::kReadBytesPeriod);
+    return rnd_.Uniform(2 * read_sampling_period_);
   }
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const MergeOperator* const merge_operator_;
+  const SliceTransform* const prefix_extractor_;  // Non-null in prefix mode
   Iterator* const iter_;
   SequenceNumber const sequence_;
   Status status_;
@@ -115,6 +169,14 @@ class DBIter : public Iterator {
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;  // Current forward entry was combined from merge operands
+  bool prefix_bounded_;  // Stop at the first key without prefix_
+  std::string prefix_;   // Prefix of the last Seek() target
+  const bool has_lower_bound_;
+  const bool has_upper_bound_;
+  std::string lower_bound_;  // Inclusive, if has_lower_bound_
+  std::string upper_bound_;  // Exclusive, if has_upper_bound_
+  const size_t read_sampling_period_;  // Zero if reads are not sampled
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -122,13 +184,15 @@ class DBIter : public Iterator {
 inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   Slice k = iter_->key();
 
-  size_t bytes_read = k.size() + iter_->value().size();
-  while (bytes_until_read_sampling_ < bytes_read) {
-    bytes_until_read_sampling_ += RandomCompactionPeriod();
-    db_->RecordReadSample(k);
+  if (read_sampling_period_ > 0) {
+    size_t bytes_read = k.size() + iter_->value().size();
+    while (bytes_until_read_sampling_ < bytes_read) {
+      bytes_until_read_sampling_ += RandomCompactionPeriod();
+      db_->RecordReadSample(k);
+    }
+    assert(bytes_until_read_sampling_ >= bytes_read);
+    bytes_until_read_sampling_ -= bytes_read;
   }
-  assert(bytes_until_read_sampling_ >= bytes_read);
-  bytes_until_read_sampling_ -= bytes_read;
 
   if (!ParseInternalKey(k, ikey)) {
     status_ = Status::Corruption("corrupted internal key in DBIter");
@@ -141,6 +205,7 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
 void DBIter::Next() {
   assert(valid_);
 
+  Slice skip = saved_key_;
   if (direction_ == kReverse) {  // Switch directions?
     direction_ = kForward;
     // iter_ is pointing just before the entries for this->key(),
@@ -157,9 +222,18 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already contains the key to skip past, and iter_ is past
+    // the entries that were merged into the current value.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
-    // Store in saved_key_ the current key so we skip it below.
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // Point skip at the current key so we skip it below.
+    SetSkipKey(ExtractUserKey(iter_->key()), &skip);
 
     // iter_ is pointing to current key. We can now safely move to the next to
     // avoid checking current key.
@@ -171,27 +245,40 @@ void DBIter::Next() {
     }
   }
 
-  FindNextUserEntry(true, &saved_key_);
+  FindNextUserEntry(true, &skip);
 }
 
-void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
+void DBIter::FindNextUserEntry(bool skipping, Slice* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    bool parsed = ParseKey(&ikey);
+    if (parsed && prefix_bounded_ && !HasSeekPrefix(ikey.user_key)) {
+      // Keys with the same prefix are adjacent, so we are done
+      break;
+    }
+    if (parsed && AtOrAfterUpperBound(ikey.user_key)) {
+      // Do not skip through the deleted or hidden entries past the bound
+      break;
+    }
+    if (parsed && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
-          SaveKey(ikey.user_key, skip);
+          SetSkipKey(ikey.user_key, skip);
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeMerge:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (ikey.type == kTypeMerge) {
+            MergeValuesForward();
+            return;
           } else {
             valid_ = true;
             saved_key_.clear();
@@ -206,14 +293,77 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeValuesForward() {
+  // iter_ is at the newest visible entry for its key, a merge operand.
+  // Collect the operands that follow until the value or deletion they
+  // apply to.
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  std::vector<std::string> operands;
+  operands.push_back(iter_->value().ToString());
+  Slice existing_value;
+  bool has_existing_value = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      operands.push_back(iter_->value().ToString());
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      existing_value = iter_->value();
+      has_existing_value = true;
+    }
+    break;
+  }
+
+  Status s = ApplyMergeOperands(merge_operator_, saved_key_,
+                                has_existing_value ? &existing_value : nullptr,
+                                operands, &saved_value_);
+  if (!s.ok()) {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    return;
+  }
+  merged_ = true;
+  valid_ = true;
+}
+
+void DBIter::PrefixModeNotSupported(const char* operation) {
+  status_ = Status::NotSupported(operation,
+                                 "not supported with prefix_same_as_start");
+  valid_ = false;
+  merged_ = false;
+  saved_key_.clear();
+  ClearSavedValue();
+}
+
 void DBIter::Prev() {
   assert(valid_);
+  if (prefix_extractor_ != nullptr) {
+    // Internal iterators skip files and blocks during seeks, which breaks
+    // the repositioning needed to change direction.
+    PrefixModeNotSupported("Prev()");
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // saved_key_ already contains the current key, and iter_ is at or
+      // past its last entry.
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -237,10 +387,17 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // Merge operands for saved_key_ newer than saved_value_, oldest first.
+  std::vector<std::string> operands;
+  bool has_value = false;  // Does saved_value_ hold a value for saved_key_?
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      bool parsed = ParseKey(&ikey);
+      if (parsed && BeforeLowerBound(ikey.user_key)) {
+        break;
+      }
+      if (parsed && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
@@ -250,7 +407,14 @@ void DBIter::FindPrevUserEntry() {
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          operands.clear();
+          has_value = false;
+        } else if (value_type == kTypeMerge) {
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          operands.push_back(iter_->value().ToString());
         } else {
+          operands.clear();
+          has_value = true;
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -264,6 +428,18 @@ void DBIter::FindPrevUserEntry() {
     } while (iter_->Valid());
   }
 
+  if (value_type != kTypeDeletion && !operands.empty()) {
+    std::reverse(operands.begin(), operands.end());
+    Slice existing_value(saved_value_);
+    Status s = ApplyMergeOperands(merge_operator_, saved_key_,
+                                  has_value ? &existing_value : nullptr,
+                                  operands, &saved_value_);
+    if (!s.ok()) {
+      status_ = s;
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -276,43 +452,87 @@ void DBIter::FindPrevUserEntry() {
 }
 
 void DBIter::Seek(const Slice& target) {
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
   saved_key_.clear();
-  AppendInternalKey(&saved_key_,
-                    ParsedInternalKey(target, sequence_, kValueTypeForSeek));
+  AppendInternalKey(
+      &saved_key_,
+      ParsedInternalKey(BeforeLowerBound(target) ? Slice(lower_bound_) : target,
+                        sequence_, kValueTypeForSeek));
   iter_->Seek(saved_key_);
   if (iter_->Valid()) {
-    FindNextUserEntry(false, &saved_key_ /* temporary storage */);
+    Slice skip;
+    FindNextUserEntry(false, &skip);
   } else {
     valid_ = false;
   }
 }
 
 void DBIter::SeekToFirst() {
+  prefix_bounded_ = false;
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
-  iter_->SeekToFirst();
+  if (has_lower_bound_) {
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_, ParsedInternalKey(lower_bound_, sequence_,
+                                                     kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+  } else {
+    iter_->SeekToFirst();
+  }
   if (iter_->Valid()) {
-    FindNextUserEntry(false, &saved_key_ /* temporary storage */);
+    Slice skip;
+    FindNextUserEntry(false, &skip);
   } else {
     valid_ = false;
   }
 }
 
 void DBIter::SeekToLast() {
+  if (prefix_extractor_ != nullptr) {
+    PrefixModeNotSupported("SeekToLast()");
+    return;
+  }
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
-  iter_->SeekToLast();
+  if (has_upper_bound_) {
+    // Position at the last entry before all entries for upper_bound_
+    saved_key_.clear();
+    AppendInternalKey(&saved_key_,
+                      ParsedInternalKey(upper_bound_, kMaxSequenceNumber,
+                                        kValueTypeForSeek));
+    iter_->Seek(saved_key_);
+    if (iter_->Valid()) {
+      iter_->Prev();
+    } else {
+      iter_->SeekToLast();
+    }
+  } else {
+    iter_->SeekToLast();
+  }
   FindPrevUserEntry();
 }
 
 }  // anonymous namespace
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+                        const MergeOperator* merge_operator,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound, const Slice* upper_bound,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        size_t read_sampling_period, uint32_t seed) {
+  return new DBIter(db, user_key_comparator, merge_operator, prefix_extractor,
+                    lower_bound, upper_bound, internal_iter, sequence,
+                    read_sampling_period, seed);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,23 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class SliceTransform;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Merge operands are combined with
+// "merge_operator".  If "prefix_extractor" is non-null, the iterator
+// works in ReadOptions::prefix_same_as_start mode.  "lower_bound" and
+// "upper_bound" are interpreted as ReadOptions::iterate_lower_bound and
+// ReadOptions::iterate_upper_bound, and "read_sampling_period" as
+// Options::read_sampling_period.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
+                        const MergeOperator* merge_operator,
+                        const SliceTransform* prefix_extractor,
+                        const Slice* lower_bound, const Slice* upper_bound,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        size_t read_sampling_period, uint32_t seed);
 
 }  // namespace leveldb
 
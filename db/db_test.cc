@@ -12,8 +12,12 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -120,6 +124,9 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Number of background jobs scheduled.
+  AtomicCounter schedule_counter_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -224,6 +231,10 @@ class SpecialEnv : public EnvWrapper {
     }
     return s;
   }
+  void Schedule(void (*function)(void*), void* arg) override {
+    schedule_counter_.Increment();
+    target()->Schedule(function, arg);
+  }
 };
 
 class DBTest {
@@ -387,6 +398,9 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
           }
         }
         iter->Next();
@@ -509,6 +523,24 @@ class DBTest {
     return false;
   }
 
+  // Returns the size of the newest log file.
+  uint64_t CurrentLogFileSize() {
+    std::vector<std::string> filenames;
+    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t number;
+    FileType type;
+    uint64_t newest = 0;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kLogFile &&
+          number > newest) {
+        newest = number;
+      }
+    }
+    uint64_t size = 0;
+    ASSERT_OK(env_->GetFileSize(LogFileName(dbname_, newest), &size));
+    return size;
+  }
+
   // Returns number of files renamed.
   int RenameLDBToSST() {
     std::vector<std::string> filenames;
@@ -604,6 +636,77 @@ TEST(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, MultipleImmutableMemTables) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_write_buffer_number = 4;
+  Reopen(&options);
+
+  // Block sync calls so that the first memtable compaction cannot finish.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  ASSERT_OK(Put("k1", std::string(100000, '1')));  // Fill memtable.
+  ASSERT_OK(Put("k2", std::string(100000, '2')));  // Switch memtable.
+  ASSERT_OK(Put("k2", "v2"));                       // Switch memtable.
+  ASSERT_OK(Put("k3", std::string(100000, '3')));
+  ASSERT_OK(Put("k4", std::string(100000, '4')));  // Switch memtable.
+  ASSERT_EQ(std::string(100000, '1'), Get("k1"));
+  ASSERT_EQ("v2", Get("k2"));
+  ASSERT_EQ(std::string(100000, '3'), Get("k3"));
+  ASSERT_EQ(std::string(100000, '4'), Get("k4"));
+  ASSERT_EQ("(k1->" + std::string(100000, '1') + ")(k2->v2)(k3->" +
+                std::string(100000, '3') + ")(k4->" +
+                std::string(100000, '4') + ")",
+            Contents());
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // The memtables that queued up behind the first one are written out
+  // together, so four memtables produce at most three tables.
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LE(TotalTableFiles(), 3);
+  ASSERT_EQ(std::string(100000, '1'), Get("k1"));
+  ASSERT_EQ("v2", Get("k2"));
+
+  Reopen(&options);
+  ASSERT_EQ(std::string(100000, '3'), Get("k3"));
+  ASSERT_EQ("v2", Get("k2"));
+}
+
+static void ReleaseDataSync(void* arg) {
+  SpecialEnv* env = reinterpret_cast<SpecialEnv*>(arg);
+  env->SleepForMicroseconds(200000);
+  env->delay_data_sync_.store(false, std::memory_order_release);
+}
+
+TEST(DBTest, WriteStallStats) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  std::string stalls;
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &stalls));
+  ASSERT_TRUE(stalls.find("memtable-limit                  0") !=
+              std::string::npos)
+      << stalls;
+
+  // Block the compaction of the first memtable so that filling the
+  // second one stalls until the sync is released.
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  ASSERT_OK(Put("k1", std::string(100000, 'x')));  // Fill memtable.
+  ASSERT_OK(Put("k2", std::string(100000, 'y')));  // Switch memtable.
+  env_->StartThread(ReleaseDataSync, env_);
+  ASSERT_OK(Put("k3", std::string(100000, 'z')));  // Stall.
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stalls", &stalls));
+  ASSERT_TRUE(stalls.find("memtable-limit                  1") !=
+              std::string::npos)
+      << stalls;
+  ASSERT_TRUE(stalls.find("level0-stop                     0") !=
+              std::string::npos)
+      << stalls;
+}
+
 TEST(DBTest, GetFromVersions) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -612,6 +715,103 @@ TEST(DBTest, GetFromVersions) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, GetPinnable) {
+  do {
+    // A value in the memtable
+    ASSERT_OK(Put("foo", "v1"));
+    PinnableSlice value;
+    ASSERT_OK(db_->Get(ReadOptions(), "foo", &value));
+    ASSERT_TRUE(value.IsPinned());
+    ASSERT_EQ("v1", value.ToString());
+
+    // Pinned values outlive overwrites and memtable compactions
+    ASSERT_OK(Put("foo", "v2"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("v1", value.ToString());
+
+    // A value in a table, which outlives compactions that delete the table
+    ASSERT_OK(db_->Get(ReadOptions(), "foo", &value));
+    ASSERT_TRUE(value.IsPinned());
+    ASSERT_EQ("v2", value.ToString());
+    ASSERT_OK(Delete("foo"));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->CompactRange(nullptr, nullptr);
+    ASSERT_EQ("v2", value.ToString());
+
+    ASSERT_TRUE(db_->Get(ReadOptions(), "foo", &value).IsNotFound());
+    ASSERT_TRUE(!value.IsPinned());
+    ASSERT_EQ("", value.ToString());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, GetValueSize) {
+  do {
+    uint64_t size;
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_OK(Put("big", std::string(1000, 'x')));
+    ASSERT_OK(db_->GetValueSize(ReadOptions(), "foo", &size));
+    ASSERT_EQ(2, size);
+    ASSERT_OK(db_->KeyExists(ReadOptions(), "foo"));
+    ASSERT_TRUE(db_->GetValueSize(ReadOptions(), "bar", &size).IsNotFound());
+    ASSERT_TRUE(db_->KeyExists(ReadOptions(), "bar").IsNotFound());
+
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(db_->GetValueSize(ReadOptions(), "big", &size));
+    ASSERT_EQ(1000, size);
+    ASSERT_OK(Delete("big"));
+    ASSERT_TRUE(db_->KeyExists(ReadOptions(), "big").IsNotFound());
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, KeyMayExist) {
+  do {
+    std::string value;
+    bool value_found;
+    ASSERT_TRUE(!db_->KeyMayExist(ReadOptions(), "foo", &value, &value_found));
+    ASSERT_TRUE(!value_found);
+    ASSERT_OK(Put("foo", "v1"));
+    ASSERT_TRUE(db_->KeyMayExist(ReadOptions(), "foo", &value, &value_found));
+    ASSERT_TRUE(value_found);
+    ASSERT_EQ("v1", value);
+
+    // Tables that are not open are not read
+    dbfull()->TEST_CompactMemTable();
+    Reopen();
+    ASSERT_TRUE(db_->KeyMayExist(ReadOptions(), "foo", &value, &value_found));
+    ASSERT_TRUE(!value_found);
+    ASSERT_EQ("v1", Get("foo"));
+
+    // Keys outside the key ranges of the tables
+    ASSERT_TRUE(!db_->KeyMayExist(ReadOptions(), "zzz", nullptr, nullptr));
+
+    ASSERT_OK(Delete("foo"));
+    ASSERT_TRUE(!db_->KeyMayExist(ReadOptions(), "foo", nullptr, nullptr));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, TableProperties) {
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("b", "v2"));
+  ASSERT_OK(Delete("a"));
+  dbfull()->TEST_CompactMemTable();
+
+  std::string props;
+  ASSERT_TRUE(db_->GetProperty("leveldb.table-properties", &props));
+  ASSERT_TRUE(props.find("table #") != std::string::npos) << props;
+  ASSERT_TRUE(props.find("entries: 3\n") != std::string::npos) << props;
+  ASSERT_TRUE(props.find("deletions: 1\n") != std::string::npos) << props;
+  ASSERT_TRUE(props.find("smallest seqno: 1\n") != std::string::npos)
+      << props;
+  ASSERT_TRUE(props.find("largest seqno: 3\n") != std::string::npos) << props;
+
+  // Tables that are not open yet are opened to read their properties
+  Reopen();
+  std::string props_after_reopen;
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.table-properties", &props_after_reopen));
+  ASSERT_EQ(props, props_after_reopen);
+}
+
 TEST(DBTest, GetMemUsage) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -1099,6 +1299,513 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_bytes_for_level_base = 64 << 10;
+  options.level_compaction_dynamic_level_bytes = true;
+  Reopen(&options);
+
+  // An empty database compacts level-0 straight into the last level.
+  Random rnd(301);
+  std::vector<std::string> values;
+  values.push_back(RandomString(&rnd, 10000));
+  ASSERT_OK(Put(Key(0), values[0]));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+
+  // As the database grows the base level moves up, but data never lands
+  // in the levels above it.
+  for (int i = 1; i < 30; i++) {
+    values.push_back(RandomString(&rnd, 100000));
+    ASSERT_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  for (int level = 1; level <= 3; level++) {
+    ASSERT_EQ(NumTableFilesAtLevel(level), 0) << FilesPerLevel();
+  }
+  ASSERT_GT(NumTableFilesAtLevel(config::kNumLevels - 1), 0);
+  for (int i = 0; i < 30; i++) {
+    ASSERT_EQ(Get(Key(i)), values[i]);
+  }
+}
+
+TEST(DBTest, Level0PickOrder) {
+  Options options = CurrentOptions();
+  options.level_compaction_dynamic_level_bytes = true;
+  Reopen(&options);
+
+  // Size compactions walk level-0 by smallest key, even though the files
+  // are kept newest first.  The oldest file holds the smallest keys and
+  // overlaps nothing, so it is moved down on its own.
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 3; i++) {
+    ASSERT_OK(Put("x", "vx"));
+    ASSERT_OK(Put("y", "vy"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 3; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("3,0,0,0,0,0,1", FilesPerLevel());
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vy", Get("y"));
+}
+
+TEST(DBTest, UniversalCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.compaction_style = kCompactionStyleUniversal;
+  Reopen(&options);
+
+  // Overwrite and delete keys repeatedly so that sorted runs hold
+  // different versions of the same keys.
+  Random rnd(301);
+  std::map<std::string, std::string> expected;
+  for (int round = 0; round < 20; round++) {
+    for (int i = 0; i < 50; i++) {
+      const std::string key = Key(rnd.Uniform(200));
+      if (rnd.OneIn(5)) {
+        ASSERT_OK(Delete(key));
+        expected.erase(key);
+      } else {
+        const std::string value = RandomString(&rnd, 1000);
+        ASSERT_OK(Put(key, value));
+        expected[key] = value;
+      }
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+
+  // Everything stays in level-0, where sorted runs get merged.
+  ASSERT_LE(NumTableFilesAtLevel(0), config::kL0_StopWritesTrigger);
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(0));
+
+  std::string contents;
+  for (const auto& kv : expected) {
+    contents += "(" + kv.first + "->" + kv.second + ")";
+  }
+  ASSERT_TRUE(contents == Contents());
+  for (int i = 0; i < 200; i++) {
+    auto it = expected.find(Key(i));
+    ASSERT_EQ(it == expected.end() ? "NOT_FOUND" : it->second, Get(Key(i)));
+  }
+
+  // A full compaction leaves a single sorted run.
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("1", FilesPerLevel());
+  Reopen(&options);
+  ASSERT_TRUE(contents == Contents());
+}
+
+TEST(DBTest, FIFOCompaction) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 1000000;
+  options.compaction_style = kCompactionStyleFIFO;
+  options.fifo_max_table_files_size = 350000;
+  Reopen(&options);
+
+  // Each round writes a table of about 100KB.
+  Random rnd(301);
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(Put(Key(round * 10 + i), RandomString(&rnd, 10000)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    // Give the background thread a chance to drop the oldest table.
+    for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 3; i++) {
+      env_->SleepForMicroseconds(1000);
+    }
+    ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(0));
+    ASSERT_LE(NumTableFilesAtLevel(0), 3);
+  }
+
+  // The oldest tables were dropped whole; the newest ones are intact.
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(69)));
+  for (int i = 70; i < 100; i++) {
+    ASSERT_EQ(10000, Get(Key(i)).size());
+  }
+
+  // Manual compactions have nothing to merge.
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("3", FilesPerLevel());
+
+  // Tables that fill the size limit exactly are kept, without background
+  // work being scheduled over and over for them.
+  uint64_t total_bytes = 0;
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  for (const std::string& filename : filenames) {
+    uint64_t number;
+    FileType type;
+    uint64_t size;
+    if (ParseFileName(filename, &number, &type) && type == kTableFile) {
+      ASSERT_OK(env_->GetFileSize(dbname_ + "/" + filename, &size));
+      total_bytes += size;
+    }
+  }
+  options.env = env_;
+  options.fifo_max_table_files_size = total_bytes;
+  Reopen(&options);
+  env_->schedule_counter_.Reset();
+  env_->SleepForMicroseconds(100000);
+  ASSERT_LE(env_->schedule_counter_.Read(), 1);
+  ASSERT_EQ("3", FilesPerLevel());
+
+  // Tables expire once they outlive the time to live.
+  options.fifo_ttl = 1;
+  Reopen(&options);
+  env_->SleepForMicroseconds(2100000);
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 1; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get(Key(99)));
+  ASSERT_EQ("v1", Get("foo"));
+}
+
+TEST(DBTest, DeletionAndAgeCompaction) {
+  // Tables only record the metadata these compactions use while they are
+  // enabled, so enable them with thresholds that are never reached.
+  Options options = CurrentOptions();
+  options.deletion_compaction_ratio = 2;
+  options.max_file_age = 1000000000;
+  Reopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 80; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  ASSERT_EQ("[ DEL, v ]", AllEntriesFor(Key(0)));
+
+  // A table made mostly of deletion markers is compacted even though no
+  // level is over its size target.
+  options.deletion_compaction_ratio = 0.5;
+  Reopen(&options);
+  for (int i = 0; i < 1000 && FilesPerLevel() != "0,0,1"; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(0)));
+  ASSERT_EQ("v", Get(Key(80)));
+
+  // Old tables keep moving down until they reach the last level.
+  options.max_file_age = 1;
+  Reopen(&options);
+  env_->SleepForMicroseconds(2100000);
+  ASSERT_OK(Put(Key(0), "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const std::string expected = "0,0,1,0,0,0,1";
+  for (int i = 0; i < 1000 && FilesPerLevel() != expected; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ(expected, FilesPerLevel());
+  ASSERT_EQ("v2", Get(Key(0)));
+  ASSERT_EQ("v", Get(Key(99)));
+}
+
+TEST(DBTest, DeletionCompactionRewritesFile) {
+  Options options = CurrentOptions();
+  options.deletion_compaction_ratio = 0.4;
+  Reopen(&options);
+
+  // Nothing lies below the table, so moving it down would keep its
+  // deletion markers forever.  It must be rewritten instead.
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  for (int i = 0; i < 80; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int i = 0; i < 1000 && FilesPerLevel() != "0,0,0,1"; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("0,0,0,1", FilesPerLevel());
+
+  std::string props;
+  ASSERT_TRUE(db_->GetProperty("leveldb.table-properties", &props));
+  ASSERT_TRUE(props.find("entries: 20\n") != std::string::npos) << props;
+  ASSERT_TRUE(props.find("deletions: 0\n") != std::string::npos) << props;
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(0)));
+  ASSERT_EQ("v", Get(Key(80)));
+}
+
+TEST(DBTest, TrivialMoveOfFileRuns) {
+  // Load sorted, non-overlapping tables into level-2.
+  Options options = CurrentOptions();
+  Reopen(&options);
+  Random rnd(301);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 10000)));
+    if (i % 10 == 9) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    }
+  }
+  ASSERT_EQ("0,0,10", FilesPerLevel());
+
+  // Once level-2 is over its target the whole run moves in one step
+  // instead of one file at a time, and nothing is rewritten.
+  options.max_bytes_for_level_base = 64 << 10;
+  Reopen(&options);
+  for (int i = 0; i < 1000 && FilesPerLevel() != "0,0,0,10"; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("0,0,0,10", FilesPerLevel());
+  std::string bytes_written;
+  ASSERT_TRUE(db_->GetProperty("leveldb.table-bytes-written", &bytes_written));
+  ASSERT_EQ("0", bytes_written);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(10000, Get(Key(i)).size());
+  }
+}
+
+TEST(DBTest, CompactionStats) {
+  ASSERT_OK(Put("a", "v1"));
+  ASSERT_OK(Put("z", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("a", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("leveldb.compaction-stats", &stats));
+  ASSERT_TRUE(stats.find("L2.input_records=3\n") != std::string::npos)
+      << stats;
+  ASSERT_TRUE(stats.find("L2.dropped_records=1\n") != std::string::npos)
+      << stats;
+  ASSERT_TRUE(stats.find("L1.read_bytes=0\n") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("L2.read_output_level_bytes=0\n") ==
+              std::string::npos)
+      << stats;
+  ASSERT_TRUE(stats.find("reason.manual=1\n") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("reason.size=0\n") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find("stall.memtable-limit.count=0\n") !=
+              std::string::npos)
+      << stats;
+
+  ASSERT_TRUE(db_->GetProperty("leveldb.stats", &stats));
+  ASSERT_TRUE(stats.find("Sum ") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find(" manual=1 ") != std::string::npos) << stats;
+  // The interval restarts every time the property is read.
+  ASSERT_TRUE(db_->GetProperty("leveldb.stats", &stats));
+  ASSERT_TRUE(stats.find("Int        1 ") != std::string::npos) << stats;
+  ASSERT_TRUE(stats.find(" 0.0   0.0      0       0\nInterval") !=
+              std::string::npos)
+      << stats;
+}
+
+TEST(DBTest, IntraL0Compaction) {
+  // Put a large table into level-1 on top of a small one in level-2.
+  const int kNumKeys = 100;
+  Options options = CurrentOptions();
+  Reopen(&options);
+  ASSERT_OK(Put(Key(0), "first"));
+  ASSERT_OK(Put(Key(kNumKeys - 1), "last"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  Random rnd(301);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 10000)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Pile up small level-0 tables without compacting them.
+  options.compaction_style = kCompactionStyleFIFO;
+  Reopen(&options);
+  for (int i = 0; i < config::kL0_SlowdownWritesTrigger; i++) {
+    ASSERT_OK(Put(Key(i), "small"));
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  }
+  ASSERT_EQ("8,1,1", FilesPerLevel());
+
+  // Merging them into level-1 would rewrite the whole large table, so
+  // they are merged into a single level-0 table instead.
+  options.compaction_style = kCompactionStyleLevel;
+  Reopen(&options);
+  for (int i = 0; i < 1000 && FilesPerLevel() != "1,1,1"; i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+  for (int i = 0; i < kNumKeys; i++) {
+    if (i < config::kL0_SlowdownWritesTrigger) {
+      ASSERT_EQ("small", Get(Key(i)));
+    } else {
+      ASSERT_EQ(10000, Get(Key(i)).size());
+    }
+  }
+}
+
+TEST(DBTest, CompactionOutputAlignment) {
+  Options options = CurrentOptions();
+  options.max_file_size = 1 << 20;
+  options.compaction_output_alignment_ratio = 0.5;
+  Reopen(&options);
+
+  // Place four small files covering 100 keys each in level-4, above a
+  // file in level-5 that covers them all.
+  ASSERT_OK(Put(Key(0), "first"));
+  ASSERT_OK(Put(Key(399), "last"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 2; level < 5; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  const std::string fname = dbname_ + ".sst";
+  for (int file = 0; file < 4; file++) {
+    SstFileWriter writer(options);
+    ASSERT_OK(writer.Open(fname));
+    for (int i = file * 100; i < (file + 1) * 100; i++) {
+      ASSERT_OK(writer.Put(Key(i), "small"));
+    }
+    ASSERT_OK(writer.Finish());
+    ASSERT_OK(db_->IngestExternalFile(IngestExternalFileOptions(), fname));
+  }
+  ASSERT_EQ("0,0,0,0,4,1", FilesPerLevel());
+
+  // Compact 600KB per such range from level-2 into level-3.  The outputs
+  // are cut at the level-4 boundaries instead of at 1MB.
+  Random rnd(301);
+  for (int i = 0; i < 400; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, 6000)));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1,0,4,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,4,4,1", FilesPerLevel());
+  std::string sstables;
+  ASSERT_TRUE(db_->GetProperty("leveldb.sstables", &sstables));
+  sstables = sstables.substr(0, sstables.find("--- level 4 ---"));
+  for (int i = 99; i < 400; i += 100) {
+    ASSERT_TRUE(sstables.find(" .. '" + Key(i) + "' @") != std::string::npos)
+        << sstables;
+  }
+
+  // Deeper levels may use larger files.
+  options.compaction_output_alignment_ratio = 0;
+  options.max_file_size_multiplier = 2;
+  Reopen(&options);
+  dbfull()->TEST_CompactRange(3, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,0,1,1", FilesPerLevel());
+  for (int i = 0; i < 400; i++) {
+    ASSERT_EQ(6000, Get(Key(i)).size());
+  }
+}
+
+TEST(DBTest, IngestExternalFile) {
+  Options options = CurrentOptions();
+  const std::string fname = dbname_ + ".sst";
+  env_->DeleteFile(fname);
+
+  // Keys must be added in order.
+  {
+    SstFileWriter writer(options);
+    ASSERT_OK(writer.Open(fname));
+    ASSERT_OK(writer.Put("b", "v"));
+    ASSERT_TRUE(writer.Put("a", "v").IsInvalidArgument());
+    ASSERT_TRUE(writer.Put("b", "v").IsInvalidArgument());
+    ASSERT_EQ(1, writer.NumEntries());
+  }
+  ASSERT_TRUE(!env_->FileExists(fname));
+  ASSERT_TRUE(!db_->IngestExternalFile(IngestExternalFileOptions(), fname).ok());
+
+  // A file that overlaps nothing goes to the last level.
+  {
+    SstFileWriter writer(options);
+    ASSERT_OK(writer.Open(fname));
+    for (int i = 0; i < 10; i++) {
+      ASSERT_OK(writer.Put(Key(i), "ingested"));
+    }
+    ASSERT_OK(writer.Finish());
+    ASSERT_EQ(10, writer.NumEntries());
+    ASSERT_GT(writer.FileSize(), 0);
+  }
+  ASSERT_OK(db_->IngestExternalFile(IngestExternalFileOptions(), fname));
+  ASSERT_TRUE(env_->FileExists(fname));
+  ASSERT_EQ("0,0,0,0,0,0,1", FilesPerLevel());
+  ASSERT_EQ("ingested", Get(Key(0)));
+  ASSERT_EQ("ingested", Get(Key(9)));
+
+  // A file that overlaps existing data hides older values, including
+  // those still in the memtable, but not from earlier snapshots.
+  ASSERT_OK(Put(Key(20), "old"));
+  ASSERT_OK(Put(Key(21), "old"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put(Key(22), "old"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  {
+    SstFileWriter writer(options);
+    ASSERT_OK(writer.Open(fname));
+    ASSERT_OK(writer.Put(Key(5), "new"));
+    ASSERT_OK(writer.Put(Key(20), "new"));
+    ASSERT_OK(writer.Delete(Key(21)));
+    ASSERT_OK(writer.Put(Key(22), "new"));
+    ASSERT_OK(writer.Finish());
+  }
+  IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+  ASSERT_OK(db_->IngestExternalFile(ingest_options, fname));
+  ASSERT_TRUE(!env_->FileExists(fname));
+  ASSERT_EQ("new", Get(Key(5)));
+  ASSERT_EQ("new", Get(Key(20)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(21)));
+  ASSERT_EQ("new", Get(Key(22)));
+  ASSERT_EQ("ingested", Get(Key(5), snapshot));
+  ASSERT_EQ("old", Get(Key(20), snapshot));
+  ASSERT_EQ("old", Get(Key(21), snapshot));
+  ASSERT_EQ("old", Get(Key(22), snapshot));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek(Key(20));
+  ASSERT_EQ(IterStatus(iter), Key(20) + "->new");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), Key(22) + "->new");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), Key(20) + "->new");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), Key(9) + "->ingested");
+  delete iter;
+  db_->ReleaseSnapshot(snapshot);
+
+  // Writes after the ingestion are newer than it.
+  ASSERT_OK(Put(Key(20), "newer"));
+  ASSERT_EQ("newer", Get(Key(20)));
+
+  // Repairing keeps the ingested data ordered with the rest.
+  Close();
+  ASSERT_OK(RepairDB(dbname_, options));
+  Reopen(&options);
+  ASSERT_EQ("new", Get(Key(5)));
+  ASSERT_EQ("ingested", Get(Key(6)));
+  ASSERT_EQ("newer", Get(Key(20)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(21)));
+  ASSERT_EQ("new", Get(Key(22)));
+
+  // The ingested data survives reopening and compactions.
+  for (int pass = 0; pass < 2; pass++) {
+    Reopen(&options);
+    ASSERT_EQ("new", Get(Key(5)));
+    ASSERT_EQ("ingested", Get(Key(6)));
+    ASSERT_EQ("newer", Get(Key(20)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(21)));
+    ASSERT_EQ("new", Get(Key(22)));
+    db_->CompactRange(nullptr, nullptr);
+  }
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1292,6 +1999,163 @@ TEST(DBTest, IteratorPinsRef) {
   delete iter;
 }
 
+TEST(DBTest, IterateBounds) {
+  // Three tables holding disjoint key ranges
+  std::vector<uint64_t> tables;
+  for (int t = 0; t < 3; t++) {
+    for (int i = t * 100; i < (t + 1) * 100; i++) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    std::vector<std::string> filenames;
+    ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+    uint64_t number, newest = 0;
+    FileType type;
+    for (size_t i = 0; i < filenames.size(); i++) {
+      if (ParseFileName(filenames[i], &number, &type) && type == kTableFile) {
+        newest = std::max(newest, number);
+      }
+    }
+    tables.push_back(newest);
+  }
+  // Hide most of the middle range behind deletions
+  for (int i = 150; i < 200; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+
+  // Tables outside the bounds are not read at all
+  Reopen();
+  ASSERT_OK(env_->DeleteFile(TableFileName(dbname_, tables[0])));
+  ASSERT_OK(env_->DeleteFile(TableFileName(dbname_, tables[2])));
+
+  std::string lower = Key(120);
+  std::string upper = Key(160);
+  Slice lower_bound(lower), upper_bound(upper);
+  ReadOptions options;
+  options.iterate_lower_bound = &lower_bound;
+  options.iterate_upper_bound = &upper_bound;
+  Iterator* iter = db_->NewIterator(options);
+
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(120 + count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(30, count);
+
+  count = 0;
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    ASSERT_EQ(Key(149 - count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(30, count);
+
+  iter->Seek(Key(10));
+  ASSERT_EQ(Key(120) + "->" + Key(120), IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek(Key(149));
+  ASSERT_EQ(Key(149) + "->" + Key(149), IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek(Key(170));
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  ASSERT_OK(iter->status());
+  delete iter;
+
+  // Without bounds the missing tables are noticed
+  iter = db_->NewIterator(ReadOptions());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+  }
+  ASSERT_TRUE(!iter->status().ok());
+  delete iter;
+}
+
+TEST(DBTest, TailingIterator) {
+  ReadOptions read_options;
+  read_options.tailing = true;
+  Iterator* iter = db_->NewIterator(read_options);
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+
+  // Seek() sees the writes made after the iterator was created
+  ASSERT_OK(Put(Key(0), "v0"));
+  iter->Seek(Key(0));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(0), iter->key().ToString());
+
+  // So does Next() at the end, across memtable compactions and
+  // compactions that replace the files of levels > 0
+  for (int i = 1; i < 300; i++) {
+    ASSERT_OK(Put(Key(i), "v" + std::to_string(i)));
+    if (i % 100 == 0) {
+      dbfull()->TEST_CompactMemTable();
+    }
+    if (i == 250) {
+      dbfull()->TEST_CompactMemTable();
+      dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+      dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+    }
+    iter->Next();
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ("v" + std::to_string(i), iter->value().ToString());
+  }
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_OK(iter->status());
+
+  ASSERT_OK(Delete(Key(10)));
+  iter->Seek(Key(10));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(11), iter->key().ToString());
+
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  iter->SeekToFirst();
+  ASSERT_OK(iter->status());
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(0), iter->key().ToString());
+  delete iter;
+}
+
+TEST(DBTest, ReadSamplingPeriod) {
+  for (int period = 1; period >= 0; period--) {
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.read_sampling_period = period;
+    DestroyAndReopen(&options);
+
+    // Two overlapping files in levels 1 and 2
+    for (int i = 0; i < 300; i++) {
+      ASSERT_OK(Put(Key(i), "v1"));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < 300; i++) {
+      ASSERT_OK(Put(Key(i), "v2"));
+    }
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+
+    // Sampling every key read charges the file in level 1 with enough
+    // seeks to compact it
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_EQ("v2", iter->value().ToString());
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+    for (int i = 0; i < 100 && NumTableFilesAtLevel(1) > 0; i++) {
+      env_->SleepForMicroseconds(10000);
+    }
+    ASSERT_EQ(period > 0 ? "0,0,1" : "0,1,1", FilesPerLevel());
+  }
+}
+
 TEST(DBTest, Snapshot) {
   do {
     Put("foo", "v1");
@@ -1325,6 +2189,9 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   do {
     Random rnd(301);
     FillLevels("a", "z");
+    // Finish the level-0 compaction FillLevels() set off so that it does
+    // not run while the snapshot below is held.
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
 
     std::string big = RandomString(&rnd, 50000);
     Put("foo", big);
@@ -1352,6 +2219,232 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+// Removes entries whose value is "expired" and upper-cases values that
+// start with "old", remembering the context of the last call.
+class ExpiringCompactionFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "ExpiringCompactionFilter"; }
+
+  Decision Filter(const Context& context, const Slice& key,
+                  const Slice& existing_value,
+                  std::string* new_value) const override {
+    last_level.store(context.level);
+    last_is_manual.store(context.is_manual_compaction);
+    if (existing_value == Slice("expired")) {
+      return kRemove;
+    } else if (existing_value.starts_with("old")) {
+      *new_value = "OLD" + existing_value.ToString().substr(3);
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+
+  mutable std::atomic<int> last_level{-1};
+  mutable std::atomic<bool> last_is_manual{false};
+};
+
+}  // namespace
+
+TEST(DBTest, CompactionFilter) {
+  ExpiringCompactionFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  // Push an old value of "foo" down to level-4.
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(3, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,0,1", FilesPerLevel());
+  ASSERT_EQ(3, filter.last_level.load());
+  ASSERT_TRUE(filter.last_is_manual.load());
+
+  ASSERT_OK(Put("foo", "expired"));
+  ASSERT_OK(Put("bar", "old value"));
+  ASSERT_OK(Put("baz", "expired"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("qux", "old but protected"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1,0,1", FilesPerLevel());
+
+  // Compacting level-2 into level-3 must hide the old value of "foo" in
+  // level-4 with a deletion marker, while "baz" can simply be dropped.
+  // The snapshot keeps "qux" away from the filter.
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,1,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("[ DEL, v1 ]", AllEntriesFor("foo"));
+  ASSERT_EQ("NOT_FOUND", Get("baz"));
+  ASSERT_EQ("[ ]", AllEntriesFor("baz"));
+  ASSERT_EQ("OLD value", Get("bar"));
+  ASSERT_EQ("old but protected", Get("qux"));
+
+  // Once the snapshot is gone, the next compaction filters "qux" too.
+  db_->ReleaseSnapshot(snapshot);
+  dbfull()->TEST_CompactRange(3, nullptr, nullptr);
+  ASSERT_EQ("OLD but protected", Get("qux"));
+  ASSERT_EQ("[ ]", AllEntriesFor("foo"));
+  ASSERT_EQ("OLD value", Get("bar"));
+
+  Close();
+}
+
+namespace {
+
+// Adds decimal operands to a decimal counter.  Counts how many operands it
+// has been asked to combine so that tests can tell where merging happens.
+class CounterMergeOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "CounterMergeOperator"; }
+
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    uint64_t sum = 0;
+    if (existing_value != nullptr && !Parse(*existing_value, &sum)) {
+      return false;
+    }
+    for (const Slice& operand : operands) {
+      uint64_t n;
+      if (!Parse(operand, &n)) {
+        return false;
+      }
+      sum += n;
+    }
+    *new_value = NumberToString(sum);
+    return true;
+  }
+
+  bool PartialMerge(const Slice& key, const Slice& left_operand,
+                    const Slice& right_operand,
+                    std::string* new_value) const override {
+    std::vector<Slice> operands = {left_operand, right_operand};
+    return FullMerge(key, nullptr, operands, new_value);
+  }
+
+ private:
+  static bool Parse(Slice s, uint64_t* n) {
+    return ConsumeDecimalNumber(&s, n) && s.empty();
+  }
+};
+
+}  // namespace
+
+TEST(DBTest, MergeOperator) {
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "c", "1").IsNotSupportedError());
+
+  CounterMergeOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+
+  // Operands alone, on top of a value, and on top of a deletion.
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "2"));
+  ASSERT_EQ("3", Get("a"));
+  ASSERT_OK(Put("b", "10"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "5"));
+  ASSERT_EQ("15", Get("b"));
+  ASSERT_OK(Delete("b"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "7"));
+  ASSERT_EQ("7", Get("b"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "c", "x"));
+  std::string value;
+  ASSERT_TRUE(db_->Get(ReadOptions(), "c", &value).IsCorruption());
+  ASSERT_OK(Delete("c"));
+
+  // Spread the operands for "a" over the memtable and several tables.
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "10"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(db_->Merge(WriteOptions(), "a", "100"));
+  ASSERT_EQ("113", Get("a"));
+  ASSERT_EQ("13", Get("a", snapshot));
+  ASSERT_EQ("(a->113)(b->7)", Contents());
+
+  // Compactions fold what every snapshot sees into a single value.
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("[ MERGE(100), 13 ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ 7 ]", AllEntriesFor("b"));
+  ASSERT_EQ("113", Get("a"));
+  ASSERT_EQ("13", Get("a", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Operands whose value lies in a deeper level are only combined with
+  // each other.
+  ASSERT_OK(Put("d", "1000"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("[ MERGE(2), MERGE(1), 1000 ]", AllEntriesFor("d"));
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("[ MERGE(3), 1000 ]", AllEntriesFor("d"));
+  ASSERT_EQ("1003", Get("d"));
+  ASSERT_EQ("(a->113)(b->7)(d->1003)", Contents());
+
+  Reopen(&options);
+  ASSERT_EQ("1003", Get("d"));
+  Close();
+}
+
+TEST(DBTest, MergeOperandsWithoutOperator) {
+  CounterMergeOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+  ASSERT_OK(Put("k", "10"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "k", "5"));
+
+  // Compactions without an operator keep the operands and the value they
+  // apply to, for a later open with the operator.
+  options.merge_operator = nullptr;
+  Reopen(&options);
+  dbfull()->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("[ MERGE(5), 10 ]", AllEntriesFor("k"));
+
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+  ASSERT_EQ("15", Get("k"));
+}
+
+TEST(DBTest, MergeOperandsAcrossFiles) {
+  CounterMergeOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  options.compression = kNoCompression;
+  options.max_file_size = 1 << 20;
+  Reopen(&options);
+
+  // Fill most of an output file ahead of "k", so that a compaction cuts
+  // its output after the large operand for "k" and writes the value of
+  // "k" to the next file.  The snapshot keeps the two apart.
+  Random rnd(301);
+  ASSERT_OK(Put("a", RandomString(&rnd, (1 << 20) - 2000)));
+  ASSERT_OK(Put("k", "10"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  const std::string operand = std::string(5000, '0') + "5";
+  ASSERT_OK(db_->Merge(WriteOptions(), "k", operand));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_EQ("0,0,0,2", FilesPerLevel());
+  ASSERT_EQ("[ MERGE(" + operand + "), 10 ]", AllEntriesFor("k"));
+
+  ASSERT_EQ("15", Get("k"));
+  ASSERT_EQ("10", Get("k", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+}
+
 TEST(DBTest, DeletionMarkers1) {
   Put("foo", "v1");
   ASSERT_OK(dbfull()->TEST_CompactMemTable());
@@ -1784,6 +2877,80 @@ TEST(DBTest, WriteSyncError) {
   ASSERT_EQ("NOT_FOUND", Get("k3"));
 }
 
+TEST(DBTest, ManualWALFlush) {
+  do {
+    WriteOptions buffered;
+    buffered.manual_wal_flush = true;
+    ASSERT_OK(Put("foo", "v1"));
+    const uint64_t flushed_size = CurrentLogFileSize();
+
+    // Buffered writes are visible but have not reached the log file.
+    ASSERT_OK(db_->Put(buffered, "foo", "v2"));
+    ASSERT_OK(db_->Put(buffered, "bar", "v3"));
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ("v3", Get("bar"));
+    ASSERT_EQ(flushed_size, CurrentLogFileSize());
+
+    ASSERT_OK(db_->FlushWAL(false));
+    ASSERT_LT(flushed_size, CurrentLogFileSize());
+
+    // A write without the flag flushes everything buffered before it.
+    ASSERT_OK(db_->Put(buffered, "baz", "v4"));
+    const uint64_t size = CurrentLogFileSize();
+    ASSERT_OK(Put("foo", "v5"));
+    ASSERT_LT(size, CurrentLogFileSize());
+
+    ASSERT_OK(db_->Put(buffered, "foo", "v6"));
+    ASSERT_OK(db_->FlushWAL(true));
+    Reopen();
+    ASSERT_EQ("v6", Get("foo"));
+    ASSERT_EQ("v3", Get("bar"));
+    ASSERT_EQ("v4", Get("baz"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, FlushWALSyncError) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+  WriteOptions buffered;
+  buffered.manual_wal_flush = true;
+  ASSERT_OK(db_->Put(buffered, "k1", "v1"));
+  ASSERT_OK(db_->FlushWAL(false));
+
+  // A failed sync leaves the log in an unknown state, so further writes
+  // are refused.
+  env_->data_sync_error_.store(true, std::memory_order_release);
+  ASSERT_TRUE(!db_->FlushWAL(true).ok());
+  env_->data_sync_error_.store(false, std::memory_order_release);
+  ASSERT_TRUE(!db_->Put(WriteOptions(), "k2", "v2").ok());
+  ASSERT_EQ("v1", Get("k1"));
+}
+
+TEST(DBTest, IngestAfterBackgroundError) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+  const std::string fname = dbname_ + ".sst";
+  env_->DeleteFile(fname);
+  {
+    SstFileWriter writer(options);
+    ASSERT_OK(writer.Open(fname));
+    ASSERT_OK(writer.Put("b", "ingested"));
+    ASSERT_OK(writer.Finish());
+  }
+
+  // A failed memtable compaction leaves the immutable memtable behind,
+  // and ingestion must report the error instead of waiting for it.
+  ASSERT_OK(Put("a", "v1"));
+  env_->data_sync_error_.store(true, std::memory_order_release);
+  ASSERT_TRUE(!dbfull()->TEST_CompactMemTable().ok());
+  env_->data_sync_error_.store(false, std::memory_order_release);
+  ASSERT_TRUE(!db_->IngestExternalFile(IngestExternalFileOptions(), fname).ok());
+  ASSERT_EQ("NOT_FOUND", Get("b"));
+  env_->DeleteFile(fname);
+}
+
 TEST(DBTest, ManifestWriteError) {
   // Test for the following problem:
   // (a) Compaction produces file F
@@ -1915,6 +3082,95 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, PrefixSameAsStart) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Ten keys for each even prefix "p000", "p002", ... "p098"
+  Random rnd(301);
+  char key[20];
+  for (int p = 0; p < 100; p += 2) {
+    for (int i = 0; i < 10; i++) {
+      snprintf(key, sizeof(key), "p%03d:%d", p, i);
+      ASSERT_OK(Put(key, RandomString(&rnd, 100)));
+    }
+  }
+  Compact("a", "z");
+  ASSERT_OK(Put("p004:3x", "new"));
+  ASSERT_OK(Delete("p004:5"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_OK(Put("p004:7", "newer"));
+
+  ReadOptions prefix_options;
+  prefix_options.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(prefix_options);
+  int count = 0;
+  for (iter->Seek("p004"); iter->Valid(); iter->Next()) {
+    ASSERT_TRUE(iter->key().starts_with("p004"));
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(10, count);  // One added, one deleted
+  iter->Seek("p004:7");
+  ASSERT_EQ("p004:7->newer", IterStatus(iter));
+  iter->Seek("p005");
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("p0");  // Outside the domain: a plain seek
+  ASSERT_EQ("p000:0", iter->key().ToString());
+  iter->Prev();
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_TRUE(iter->status().IsNotSupportedError());
+  delete iter;
+
+  // Seeks to missing prefixes should rarely read a block
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  for (int pass = 0; pass < 2; pass++) {
+    ReadOptions read_options;
+    read_options.prefix_same_as_start = (pass == 1);
+    env_->random_read_counter_.Reset();
+    for (int p = 1; p < 100; p += 2) {
+      iter = db_->NewIterator(read_options);
+      snprintf(key, sizeof(key), "p%03d:", p);
+      iter->Seek(key);
+      ASSERT_EQ(pass == 0 && p < 99, iter->Valid());
+      delete iter;
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "50 missing prefixes (prefix mode %d) => %d reads\n",
+            pass, reads);
+    if (pass == 0) {
+      ASSERT_GE(reads, 50);
+    } else {
+      ASSERT_LE(reads, 5);
+    }
+  }
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Prefixes from another transform are not used, but the iterator still
+  // stops at the end of the shorter prefix
+  delete options.prefix_extractor;
+  options.prefix_extractor = NewFixedPrefixTransform(3);
+  Reopen(&options);
+  iter = db_->NewIterator(prefix_options);
+  count = 0;
+  for (iter->Seek("p096"); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  ASSERT_EQ(20, count);  // "p096" and "p098"
+  delete iter;
+
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2031,6 +3287,10 @@ class ModelDB : public DB {
   Status Delete(const WriteOptions& o, const Slice& key) override {
     return DB::Delete(o, key);
   }
+  Status Merge(const WriteOptions& o, const Slice& key,
+               const Slice& value) override {
+    return DB::Merge(o, key, value);
+  }
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override {
     assert(false);  // Not implemented
@@ -2064,9 +3324,25 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void Merge(const Slice& key, const Slice& value) override {
+        KVMap::iterator it = map_->find(key.ToString());
+        Slice existing_value;
+        if (it != map_->end()) {
+          existing_value = it->second;
+        }
+        std::vector<Slice> operands(1, value);
+        std::string result;
+        if (merge_operator_->FullMerge(
+                key, it != map_->end() ? &existing_value : nullptr, operands,
+                &result)) {
+          (*map_)[key.ToString()] = result;
+        }
+      }
+      const MergeOperator* merge_operator_;
     };
     Handler handler;
     handler.map_ = &map_;
+    handler.merge_operator_ = options_.merge_operator;
     return batch->Iterate(&handler);
   }
 
@@ -2079,6 +3355,11 @@ class ModelDB : public DB {
     }
   }
   void CompactRange(const Slice* start, const Slice* end) override {}
+  Status FlushWAL(bool sync) override { return Status::OK(); }
+  Status IngestExternalFile(const IngestExternalFileOptions& options,
+                            const std::string& fname) override {
+    return Status::NotSupported("IngestExternalFile", fname);
+  }
 
  private:
   class ModelIter : public Iterator {
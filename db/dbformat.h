@@ -11,6 +11,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -39,9 +40,6 @@ static const int kL0_StopWritesTrigger = 12;
 // space if the same key space is being repeatedly overwritten.
 static const int kMaxMemCompactLevel = 2;
 
-// Approximate gap in bytes between samples of data read during iteration.
-static const int kReadBytesPeriod = 1048576;
-
 }  // namespace config
 
 class InternalKey;
@@ -49,14 +47,14 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1, kTypeMerge = 0x2 };
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 typedef uint64_t SequenceNumber;
 
@@ -129,6 +127,24 @@ class InternalFilterPolicy : public FilterPolicy {
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
 };
 
+// Prefix extractor wrapper that applies a user-key transform to internal
+// keys.  Transform() returns the user-key prefix followed by the next
+// eight bytes of the internal key, which InternalFilterPolicy strips
+// again, so that the filters hold and are probed with the user-key prefix.
+class InternalKeySliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalKeySliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const char* Name() const override;
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override;
+
+  const SliceTransform* user_transform() const { return user_transform_; }
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -182,7 +198,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<unsigned char>(kTypeValue));
+  return (c <= static_cast<unsigned char>(kTypeMerge));
 }
 
 /*
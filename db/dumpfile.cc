@@ -16,6 +16,7 @@
 #include "leveldb/options.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
+#include "leveldb/table_properties.h"
 #include "leveldb/write_batch.h"
 #include "util/logging.h"
 
@@ -23,7 +24,7 @@ namespace leveldb {
 
 namespace {
 
-bool GuessType(const std::string& fname, FileType* type) {
+bool GuessType(const std::string& fname, FileType* type, uint64_t* number) {
   size_t pos = fname.rfind('/');
   std::string basename;
   if (pos == std::string::npos) {
@@ -31,8 +32,7 @@ bool GuessType(const std::string& fname, FileType* type) {
   } else {
     basename = std::string(fname.data() + pos + 1, fname.size() - pos - 1);
   }
-  uint64_t ignored;
-  return ParseFileName(basename, &ignored, type);
+  return ParseFileName(basename, number, type);
 }
 
 // Notified when log reader encounters corruption.
@@ -52,6 +52,7 @@ class CorruptionReporter : public log::Reader::Reporter {
 
 // Print contents of a log file. (*func)() is called on every record.
 Status PrintLogContents(Env* env, const std::string& fname,
+                        uint64_t log_number,
                         void (*func)(uint64_t, Slice, WritableFile*),
                         WritableFile* dst) {
   SequentialFile* file;
@@ -61,7 +62,7 @@ Status PrintLogContents(Env* env, const std::string& fname,
   }
   CorruptionReporter reporter;
   reporter.dst_ = dst;
-  log::Reader reader(file, &reporter, true, 0);
+  log::Reader reader(file, &reporter, true, 0, log_number);
   Slice record;
   std::string scratch;
   while (reader.ReadRecord(&record, &scratch)) {
@@ -88,6 +89,14 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void Merge(const Slice& key, const Slice& value) override {
+    std::string r = "  merge '";
+    AppendEscapedStringTo(&r, key);
+    r += "' '";
+    AppendEscapedStringTo(&r, value);
+    r += "'\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
@@ -119,8 +128,9 @@ static void WriteBatchPrinter(uint64_t pos, Slice record, WritableFile* dst) {
   }
 }
 
-Status DumpLog(Env* env, const std::string& fname, WritableFile* dst) {
-  return PrintLogContents(env, fname, WriteBatchPrinter, dst);
+Status DumpLog(Env* env, const std::string& fname, uint64_t log_number,
+               WritableFile* dst) {
+  return PrintLogContents(env, fname, log_number, WriteBatchPrinter, dst);
 }
 
 // Called on every log record (each one of which is a WriteBatch)
@@ -141,7 +151,8 @@ static void VersionEditPrinter(uint64_t pos, Slice record, WritableFile* dst) {
 }
 
 Status DumpDescriptor(Env* env, const std::string& fname, WritableFile* dst) {
-  return PrintLogContents(env, fname, VersionEditPrinter, dst);
+  return PrintLogContents(env, fname, 0 /*log_number*/, VersionEditPrinter,
+                          dst);
 }
 
 Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
@@ -165,6 +176,13 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
     return s;
   }
 
+  const TableProperties* props = table->GetProperties();
+  if (props != nullptr) {
+    dst->Append("--- properties ---\n");
+    dst->Append(props->ToString());
+    dst->Append("--- entries ---\n");
+  }
+
   ReadOptions ro;
   ro.fill_cache = false;
   Iterator* iter = table->NewIterator(ro);
@@ -189,6 +207,8 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
         r += "del";
       } else if (key.type == kTypeValue) {
         r += "val";
+      } else if (key.type == kTypeMerge) {
+        r += "merge";
       } else {
         AppendNumberTo(&r, key.type);
       }
@@ -213,12 +233,13 @@ Status DumpTable(Env* env, const std::string& fname, WritableFile* dst) {
 
 Status DumpFile(Env* env, const std::string& fname, WritableFile* dst) {
   FileType ftype;
-  if (!GuessType(fname, &ftype)) {
+  uint64_t number;
+  if (!GuessType(fname, &ftype, &number)) {
     return Status::InvalidArgument(fname + ": unknown file type");
   }
   switch (ftype) {
     case kLogFile:
-      return DumpLog(env, fname, dst);
+      return DumpLog(env, fname, number, dst);
     case kDescriptorFile:
       return DumpDescriptor(env, fname, dst);
     case kTableFile:
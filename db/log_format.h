@@ -20,15 +20,39 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // Variants of kFullType and kFirstType whose logical record payload
+  // is snappy compressed.  Any continuation fragments of a compressed
+  // record use the ordinary kMiddleType and kLastType.
+  kCompressedFullType = 5,
+  kCompressedFirstType = 6,
+
+  // Variants of all of the above whose header also carries the number
+  // of the log file they were written to.  Used by log files that may
+  // be recycled, so that stale records left over from the file's
+  // previous incarnation can be told apart from fresh ones.
+  kRecyclableFullType = 7,
+  kRecyclableFirstType = 8,
+  kRecyclableMiddleType = 9,
+  kRecyclableLastType = 10,
+  kRecyclableCompressedFullType = 11,
+  kRecyclableCompressedFirstType = 12
 };
-static const int kMaxRecordType = kLastType;
+static const int kMaxRecordType = kRecyclableCompressedFirstType;
+
+// Difference between a recyclable record type and its plain counterpart.
+static const int kRecyclableTypeOffset = kRecyclableFullType - kFullType;
 
 static const int kBlockSize = 32768;
 
 // Header is checksum (4 bytes), length (2 bytes), type (1 byte).
 static const int kHeaderSize = 4 + 2 + 1;
 
+// Recyclable header is checksum (4 bytes), length (2 bytes), type (1 byte),
+// log number (4 bytes).
+static const int kRecyclableHeaderSize = 4 + 2 + 1 + 4;
+
 }  // namespace log
 }  // namespace leveldb
 
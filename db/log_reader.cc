@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -16,7 +17,7 @@ namespace log {
 Reader::Reporter::~Reporter() = default;
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
@@ -26,6 +27,8 @@ Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
       last_record_offset_(0),
       end_of_buffer_offset_(0),
       initial_offset_(initial_offset),
+      log_number_(static_cast<uint32_t>(log_number)),
+      recyclable_(false),
       resyncing_(initial_offset > 0) {}
 
 Reader::~Reader() { delete[] backing_store_; }
@@ -63,19 +66,23 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
   scratch->clear();
   record->clear();
   bool in_fragmented_record = false;
+  // True if the record being assembled was written compressed
+  bool compressed_record = false;
   // Record offset of the logical record that we're reading
   // 0 is a dummy value to make compilers happy
   uint64_t prospective_record_offset = 0;
 
   Slice fragment;
   while (true) {
-    const unsigned int record_type = ReadPhysicalRecord(&fragment);
+    int header_size = kHeaderSize;
+    const unsigned int record_type =
+        ReadPhysicalRecord(&fragment, &header_size);
 
     // ReadPhysicalRecord may have only had an empty trailer remaining in its
     // internal buffer. Calculate the offset of the next physical record now
     // that it has returned, properly accounting for its header size.
     uint64_t physical_record_offset =
-        end_of_buffer_offset_ - buffer_.size() - kHeaderSize - fragment.size();
+        end_of_buffer_offset_ - buffer_.size() - header_size - fragment.size();
 
     if (resyncing_) {
       if (record_type == kMiddleType) {
@@ -90,6 +97,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
 
     switch (record_type) {
       case kFullType:
+      case kCompressedFullType:
         if (in_fragmented_record) {
           // Handle bug in earlier versions of log::Writer where
           // it could emit an empty kFirstType record at the tail end
@@ -102,10 +110,15 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->clear();
         *record = fragment;
+        if (record_type == kCompressedFullType && !UncompressRecord(record)) {
+          in_fragmented_record = false;
+          break;
+        }
         last_record_offset_ = prospective_record_offset;
         return true;
 
       case kFirstType:
+      case kCompressedFirstType:
         if (in_fragmented_record) {
           // Handle bug in earlier versions of log::Writer where
           // it could emit an empty kFirstType record at the tail end
@@ -118,6 +131,7 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->assign(fragment.data(), fragment.size());
         in_fragmented_record = true;
+        compressed_record = (record_type == kCompressedFirstType);
         break;
 
       case kMiddleType:
@@ -136,6 +150,11 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         } else {
           scratch->append(fragment.data(), fragment.size());
           *record = Slice(*scratch);
+          if (compressed_record && !UncompressRecord(record)) {
+            in_fragmented_record = false;
+            scratch->clear();
+            break;
+          }
           last_record_offset_ = prospective_record_offset;
           return true;
         }
@@ -175,6 +194,23 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
 
 uint64_t Reader::LastRecordOffset() { return last_record_offset_; }
 
+bool Reader::UncompressRecord(Slice* record) {
+  size_t ulength = 0;
+  if (!port::Snappy_GetUncompressedLength(record->data(), record->size(),
+                                          &ulength)) {
+    ReportCorruption(record->size(), "corrupted compressed record");
+    return false;
+  }
+  uncompressed_.resize(ulength);
+  if (!port::Snappy_Uncompress(record->data(), record->size(),
+                               &uncompressed_[0])) {
+    ReportCorruption(record->size(), "corrupted compressed record");
+    return false;
+  }
+  *record = Slice(uncompressed_);
+  return true;
+}
+
 void Reader::ReportCorruption(uint64_t bytes, const char* reason) {
   ReportDrop(bytes, Status::Corruption(reason));
 }
@@ -186,7 +222,7 @@ void Reader::ReportDrop(uint64_t bytes, const Status& reason) {
   }
 }
 
-unsigned int Reader::ReadPhysicalRecord(Slice* result) {
+unsigned int Reader::ReadPhysicalRecord(Slice* result, int* header_size) {
   while (true) {
     if (buffer_.size() < kHeaderSize) {
       if (!eof_) {
@@ -217,18 +253,23 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const char* header = buffer_.data();
     const uint32_t a = static_cast<uint32_t>(header[4]) & 0xff;
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
-    const unsigned int type = header[6];
+    unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    *header_size = kHeaderSize;
+    if (type >= kRecyclableFullType && type <= kRecyclableCompressedFirstType) {
+      *header_size = kRecyclableHeaderSize;
+    }
+    if (*header_size + length > buffer_.size()) {
       size_t drop_size = buffer_.size();
       buffer_.clear();
-      if (!eof_) {
+      if (!eof_ && !recyclable_) {
         ReportCorruption(drop_size, "bad record length");
         return kBadRecord;
       }
       // If the end of the file has been reached without reading |length| bytes
       // of payload, assume the writer died in the middle of writing the record.
-      // Don't report a corruption.
+      // Don't report a corruption.  The same goes for recyclable logs, whose
+      // live data may be followed by leftovers from the file's previous use.
       return kEof;
     }
 
@@ -243,7 +284,8 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc =
+          crc32c::Value(header + 6, *header_size - 6 + length);
       if (actual_crc != expected_crc) {
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
@@ -251,21 +293,35 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
         // like a valid log record.
         size_t drop_size = buffer_.size();
         buffer_.clear();
+        if (recyclable_) {
+          // Most likely the tail of a previous incarnation of the file.
+          return kEof;
+        }
         ReportCorruption(drop_size, "checksum mismatch");
         return kBadRecord;
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    if (*header_size == kRecyclableHeaderSize) {
+      if (DecodeFixed32(header + kHeaderSize) != log_number_) {
+        // A record from before the file was recycled: end of the log.
+        buffer_.clear();
+        return kEof;
+      }
+      recyclable_ = true;
+      type -= kRecyclableTypeOffset;
+    }
+
+    buffer_.remove_prefix(*header_size + length);
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - *header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + *header_size, length);
     return type;
   }
 }
@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 
+#include <string>
+
 #include "db/log_format.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
@@ -40,8 +42,12 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // "log_number" is the number of the log file being read.  Recyclable
+  // records tagged with a different log number are left over from an
+  // earlier use of a recycled file and mark the end of the log.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   Reader(const Reader&) = delete;
   Reader& operator=(const Reader&) = delete;
@@ -60,6 +66,11 @@ class Reader {
   // Undefined before the first call to ReadRecord.
   uint64_t LastRecordOffset();
 
+  // Returns true if any record read so far was in the recyclable format,
+  // in which case the file may contain stale data past the end of the log
+  // and must not be appended to.
+  bool IsRecyclable() const { return recyclable_; }
+
  private:
   // Extend record types with the following special values
   enum {
@@ -77,8 +88,15 @@ class Reader {
   // Returns true on success. Handles reporting.
   bool SkipToInitialBlock();
 
-  // Return type, or one of the preceding special values
-  unsigned int ReadPhysicalRecord(Slice* result);
+  // Return type, or one of the preceding special values.  Recyclable
+  // record types are mapped to their plain counterparts.  Stores the size
+  // of the record's header in *header_size.
+  unsigned int ReadPhysicalRecord(Slice* result, int* header_size);
+
+  // Replace "*record" with its uncompressed contents, which are stored
+  // in uncompressed_.  Returns false (and reports the drop) if the
+  // record could not be uncompressed.
+  bool UncompressRecord(Slice* record);
 
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
@@ -90,6 +108,7 @@ class Reader {
   bool const checksum_;
   char* const backing_store_;
   Slice buffer_;
+  std::string uncompressed_;  // Contents of the last compressed record
   bool eof_;  // Last Read() indicated EOF by returning < kBlockSize
 
   // Offset of the last record returned by ReadRecord.
@@ -100,6 +119,12 @@ class Reader {
   // Offset at which to start looking for the first record to return
   uint64_t const initial_offset_;
 
+  // Low 32 bits of the number of the log being read
+  uint32_t const log_number_;
+
+  // True if we have seen a record in the recyclable format
+  bool recyclable_;
+
   // True if we are resynchronizing after a seek (initial_offset_ > 0). In
   // particular, a run of kMiddleType and kLastType records can be silently
   // skipped in this mode
@@ -5,6 +5,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "leveldb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/random.h"
@@ -36,6 +37,23 @@ static std::string RandomSkewedString(int i, Random* rnd) {
   return BigString(NumberString(i), rnd->Skewed(17));
 }
 
+// Return a string of length n made of runs of repeated characters, which
+// compresses well but still spans several blocks once compressed.
+static std::string CompressibleString(Random* rnd, size_t n) {
+  std::string result;
+  while (result.size() < n) {
+    result.append(1 + rnd->Uniform(16), static_cast<char>(rnd->Uniform(256)));
+  }
+  result.resize(n);
+  return result;
+}
+
+static bool SnappyCompressionSupported() {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaa";
+  return port::Snappy_Compress(in.data(), in.size(), &out);
+}
+
 class LogTest {
  public:
   LogTest()
@@ -54,6 +72,24 @@ class LogTest {
     writer_ = new Writer(&dest_, dest_.contents_.size());
   }
 
+  void UseCompression() {
+    delete writer_;
+    writer_ = new Writer(&dest_, dest_.contents_.size(), kSnappyCompression);
+  }
+
+  // Simulate reusing the log file for log "log_number": restart writing
+  // at offset zero while leaving the previous contents past the newly
+  // written data in place.
+  void Recycle(uint64_t log_number) {
+    delete writer_;
+    delete reader_;
+    stale_contents_ = dest_.contents_;
+    dest_.contents_.clear();
+    writer_ = new Writer(&dest_, kNoCompression, log_number);
+    reader_ = new Reader(&source_, &report_, true /*checksum*/,
+                         0 /*initial_offset*/, log_number);
+  }
+
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
     writer_->AddRecord(Slice(msg));
@@ -64,6 +100,10 @@ class LogTest {
   std::string Read() {
     if (!reading_) {
       reading_ = true;
+      if (stale_contents_.size() > dest_.contents_.size()) {
+        dest_.contents_.append(stale_contents_, dest_.contents_.size(),
+                               std::string::npos);
+      }
       source_.contents_ = Slice(dest_.contents_);
     }
     std::string scratch;
@@ -228,6 +268,7 @@ class LogTest {
   static int num_initial_offset_records_;
 
   StringDest dest_;
+  std::string stale_contents_;  // Leftovers from before Recycle()
   StringSource source_;
   ReportCollector report_;
   bool reading_;
@@ -361,6 +402,112 @@ TEST(LogTest, RandomRead) {
   ASSERT_EQ("EOF", Read());
 }
 
+TEST(LogTest, CompressedReadWrite) {
+  Random rnd(301);
+  const std::string medium = CompressibleString(&rnd, 50000);
+  const std::string large = CompressibleString(&rnd, 300000);
+  UseCompression();
+  Write("foo");
+  Write("");
+  Write(medium);
+  Write(large);
+  Write("bar");
+  if (SnappyCompressionSupported()) {
+    ASSERT_LT(WrittenBytes(), medium.size() + large.size());
+  }
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(medium, Read());
+  ASSERT_EQ(large, Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, CompressedRandomRead) {
+  UseCompression();
+  const int N = 500;
+  Random write_rnd(301);
+  for (int i = 0; i < N; i++) {
+    Write(RandomSkewedString(i, &write_rnd));
+  }
+  Random read_rnd(301);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(RandomSkewedString(i, &read_rnd), Read());
+  }
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST(LogTest, MixedCompression) {
+  Random rnd(301);
+  const std::string compressible = CompressibleString(&rnd, 10000);
+  Write(BigString("plain", 10000));
+  UseCompression();
+  Write(compressible);
+  ReopenForAppend();
+  Write("plain again");
+  ASSERT_EQ(BigString("plain", 10000), Read());
+  ASSERT_EQ(compressible, Read());
+  ASSERT_EQ("plain again", Read());
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST(LogTest, RecyclableReadWrite) {
+  Recycle(7);
+  Write("foo");
+  Write(BigString("bar", 3 * kBlockSize));
+  Write("");
+  Write("baz");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", 3 * kBlockSize), Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("baz", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogIgnoresStaleRecords) {
+  Recycle(1);
+  for (int i = 0; i < 1000; i++) {
+    Write(NumberString(i));
+  }
+  Write(BigString("old", 2 * kBlockSize));
+  Recycle(2);
+  Write("foo");
+  Write(BigString("bar", kBlockSize));
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", kBlockSize), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST(LogTest, RecycledPlainLogIgnoresStaleRecords) {
+  // Records of a log file not written in the recyclable format.
+  for (int i = 0; i < 100; i++) {
+    Write(BigString(NumberString(i), 1000));
+  }
+  Recycle(2);
+  Write("foo");
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("EOF", Read());
+}
+
+TEST(LogTest, RecyclableMarginalTrailer) {
+  Recycle(3);
+  // Leave a trailer that is too small for a recyclable header but large
+  // enough for a plain one.
+  const int n = kBlockSize - kRecyclableHeaderSize - kHeaderSize;
+  Write(BigString("foo", n));
+  ASSERT_EQ(kBlockSize - kHeaderSize, WrittenBytes());
+  Write("bar");
+  ASSERT_EQ(kBlockSize + kRecyclableHeaderSize + 3, WrittenBytes());
+  ASSERT_EQ(BigString("foo", n), Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
 // Tests of all the error paths in log_reader.cc follow:
 
 TEST(LogTest, ReadError) {
@@ -381,6 +528,18 @@ TEST(LogTest, BadRecordType) {
   ASSERT_EQ("OK", MatchError("unknown record type"));
 }
 
+TEST(LogTest, BadCompressedRecord) {
+  Write("foo");
+  Write("bar");
+  // "foo" is not a valid compressed payload.
+  SetByte(6, kCompressedFullType);
+  FixChecksum(0, 3);
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(3, DroppedBytes());
+  ASSERT_EQ("OK", MatchError("corrupted compressed record"));
+}
+
 TEST(LogTest, TruncatedTrailingRecordIsIgnored) {
   Write("foo");
   ShrinkSize(4);  // Drop all payload as well as a header byte
@@ -7,7 +7,10 @@
 
 #include <stdint.h>
 
+#include <string>
+
 #include "db/log_format.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 
@@ -22,25 +25,42 @@ class Writer {
   // Create a writer that will append data to "*dest".
   // "*dest" must be initially empty.
   // "*dest" must remain live while this Writer is in use.
-  explicit Writer(WritableFile* dest);
+  //
+  // If "compression" is not kNoCompression, each logical record is
+  // compressed before being fragmented into physical records.
+  //
+  // If "log_number" is non-zero, records are written in the recyclable
+  // format, whose headers carry (the low 32 bits of) "log_number".
+  explicit Writer(WritableFile* dest,
+                  CompressionType compression = kNoCompression,
+                  uint64_t log_number = 0);
 
   // Create a writer that will append data to "*dest".
   // "*dest" must have initial length "dest_length".
   // "*dest" must remain live while this Writer is in use.
-  Writer(WritableFile* dest, uint64_t dest_length);
+  Writer(WritableFile* dest, uint64_t dest_length,
+         CompressionType compression = kNoCompression,
+         uint64_t log_number = 0);
 
   Writer(const Writer&) = delete;
   Writer& operator=(const Writer&) = delete;
 
   ~Writer();
 
-  Status AddRecord(const Slice& slice);
+  // Append "slice" as a single logical record.  If "flush" is false, the
+  // record may be left in the buffer of the destination file until a
+  // later flush of that file.
+  Status AddRecord(const Slice& slice, bool flush = true);
 
  private:
   Status EmitPhysicalRecord(RecordType type, const char* ptr, size_t length);
 
   WritableFile* dest_;
   int block_offset_;  // Current offset in block
+  const CompressionType compression_;
+  const uint32_t log_number_;  // Only used for recyclable records
+  const int header_size_;
+  std::string compressed_;  // Scratch buffer for compressed records
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
@@ -66,6 +66,9 @@ class MemTableIterator : public Iterator {
 
   Status status() const override { return Status::OK(); }
 
+  // Keys live in the arena of the memtable
+  bool IsKeyPinned() const override { return true; }
+
  private:
   MemTable::Table::Iterator iter_;
   std::string tmp_;  // For passing to EncodeKey
@@ -98,11 +101,12 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   table_.Insert(buf);
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, Slice* value, Status* s,
+                   std::vector<std::string>* merge_operands) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (; iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -120,16 +124,21 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
       switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
+        case kTypeValue:
+          *value = GetLengthPrefixedSlice(key_ptr + key_length);
           return true;
-        }
         case kTypeDeletion:
           *s = Status::NotFound(Slice());
           return true;
+        case kTypeMerge: {
+          // Keep looking for the value the operand applies to
+          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+          merge_operands->push_back(v.ToString());
+          continue;
+        }
       }
     }
+    break;
   }
   return false;
 }
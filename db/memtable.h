@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/skiplist.h"
@@ -56,11 +57,16 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
-  // If memtable contains a value for key, store it in *value and return true.
+  // If memtable contains a value for key, point *value at it and return
+  // true.  The value lives as long as the memtable.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // Merge operands for key that are newer than the value or deletion are
+  // appended to *merge_operands, newest first.
+  bool Get(const LookupKey& key, Slice* value, Status* s,
+           std::vector<std::string>* merge_operands);
 
  private:
   friend class MemTableIterator;
@@ -0,0 +1,32 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& user_key, const Slice* existing_value,
+                          const std::vector<std::string>& operands,
+                          std::string* value) {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("merge operand found without a merge operator",
+                                user_key);
+  }
+  std::vector<Slice> ordered;
+  ordered.reserve(operands.size());
+  for (size_t i = operands.size(); i > 0; i--) {
+    ordered.push_back(operands[i - 1]);
+  }
+  std::string result;
+  if (!merge_operator->FullMerge(user_key, existing_value, ordered, &result)) {
+    return Status::Corruption("merge failed for key", user_key);
+  }
+  value->swap(result);
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,28 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Apply the merge "operands" for "user_key" to "existing_value" (nullptr
+// if there is none) and store the result in *value.  "operands" are
+// ordered from newest to oldest, the order in which lookups find them.
+Status ApplyMergeOperands(const MergeOperator* merge_operator,
+                          const Slice& user_key, const Slice* existing_value,
+                          const std::vector<std::string>& operands,
+                          std::string* value);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
@@ -270,6 +270,59 @@ TEST(RecoveryTest, MultipleMemTables) {
   }
 }
 
+TEST(RecoveryTest, CompressedLogFile) {
+  Options opt;
+  opt.create_if_missing = true;
+  opt.wal_compression = kSnappyCompression;
+  Open(&opt);
+  const int kNum = 1000;
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%050d", i);
+    ASSERT_OK(Put(buf, std::string(1000, 'a' + (i % 26))));
+  }
+  Close();
+  ASSERT_EQ(0, NumTables());
+
+  // Recovery does not depend on the option used for the new log.
+  Open();
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%050d", i);
+    ASSERT_EQ(std::string(1000, 'a' + (i % 26)), Get(buf));
+  }
+}
+
+TEST(RecoveryTest, RecycleLogFiles) {
+  Options opt;
+  opt.create_if_missing = true;
+  opt.recycle_log_file_num = 1;
+  opt.write_buffer_size = 10000;
+  Open(&opt);
+  const int kNum = 2000;
+  for (int i = 0; i < kNum; i++) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%050d", i);
+    ASSERT_OK(Put(buf, buf));
+    // At most the current log and one recyclable log are kept.
+    ASSERT_LE(NumLogs(), 2);
+  }
+  ASSERT_LE(2, NumTables());
+  Close();
+
+  // The recycled log holds leftovers from the log it used to be; they
+  // must not confuse recovery, with or without recycling enabled.
+  for (int i = 0; i < 2; i++) {
+    opt.recycle_log_file_num = i;
+    Open(&opt);
+    for (int j = 0; j < kNum; j++) {
+      char buf[100];
+      snprintf(buf, sizeof(buf), "%050d", j);
+      ASSERT_EQ(buf, Get(buf));
+    }
+  }
+}
+
 TEST(RecoveryTest, MultipleLogFiles) {
   ASSERT_OK(Put("foo", "bar"));
   Close();
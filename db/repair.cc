@@ -7,6 +7,9 @@
 // (2) We scan every table to compute
 //     (a) smallest/largest for the table
 //     (b) largest sequence number in the table
+//     (c) for ingested tables, the sequence number they were added at,
+//         as recorded by the old descriptors.  Tables for which it is
+//         lost are dropped.
 // (3) We generate descriptor contents:
 //      - log number is set to zero
 //      - next-file-number is set to 1 + largest file number we found
@@ -24,6 +27,8 @@
 //   Store per-table metadata (smallest, largest, largest-seq#, ...)
 //   in the table's meta section to speed up ScanTable.
 
+#include <map>
+
 #include "db/builder.h"
 #include "db/db_impl.h"
 #include "db/dbformat.h"
@@ -49,7 +54,9 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        iprefix_(options.prefix_extractor),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, &iprefix_,
+                                 options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -70,6 +77,7 @@ class Repairer {
   Status Run() {
     Status status = FindFiles();
     if (status.ok()) {
+      ReadGlobalSeqnos();
       ConvertLogFilesToTables();
       ExtractMetaData();
       status = WriteDescriptor();
@@ -128,6 +136,51 @@ class Repairer {
     return status;
   }
 
+  // Ingested tables hold entries with sequence number zero; the sequence
+  // number they were ingested at is only recorded in the descriptor.
+  // Recover it from whatever the old descriptors still hold.
+  void ReadGlobalSeqnos() {
+    struct LogReporter : public log::Reader::Reporter {
+      Logger* info_log;
+      std::string fname;
+      void Corruption(size_t bytes, const Status& s) override {
+        Log(info_log, "%s: dropping %d bytes; %s", fname.c_str(),
+            static_cast<int>(bytes), s.ToString().c_str());
+      }
+    };
+
+    for (size_t i = 0; i < manifests_.size(); i++) {
+      const std::string fname = dbname_ + "/" + manifests_[i];
+      SequentialFile* file;
+      Status status = env_->NewSequentialFile(fname, &file);
+      if (!status.ok()) {
+        Log(options_.info_log, "%s: ignoring %s", fname.c_str(),
+            status.ToString().c_str());
+        continue;
+      }
+      LogReporter reporter;
+      reporter.info_log = options_.info_log;
+      reporter.fname = fname;
+      log::Reader reader(file, &reporter, true /*checksum*/,
+                         0 /*initial_offset*/);
+      std::string scratch;
+      Slice record;
+      while (reader.ReadRecord(&record, &scratch)) {
+        VersionEdit edit;
+        if (!edit.DecodeFrom(record).ok()) {
+          continue;
+        }
+        for (const auto& new_file : edit.new_files()) {
+          const FileMetaData& f = new_file.second;
+          if (f.global_seqno != 0) {
+            global_seqnos_[f.number] = f.global_seqno;
+          }
+        }
+      }
+      delete file;
+    }
+  }
+
   void ConvertLogFilesToTables() {
     for (size_t i = 0; i < logs_.size(); i++) {
       std::string logname = LogFileName(dbname_, logs_[i]);
@@ -171,7 +224,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false /*do not checksum*/,
-                       0 /*initial_offset*/);
+                       0 /*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -268,14 +321,22 @@ class Repairer {
       }
 
       counter++;
+      t.meta.num_entries++;
+      if (parsed.type == kTypeDeletion) {
+        t.meta.num_deletions++;
+      }
       if (empty) {
         empty = false;
         t.meta.smallest.DecodeFrom(key);
+        t.meta.smallest_seqno = parsed.sequence;
       }
       t.meta.largest.DecodeFrom(key);
       if (parsed.sequence > t.max_sequence) {
         t.max_sequence = parsed.sequence;
       }
+      if (parsed.sequence < t.meta.smallest_seqno) {
+        t.meta.smallest_seqno = parsed.sequence;
+      }
     }
     if (!iter->status().ok()) {
       status = iter->status();
@@ -284,6 +345,20 @@ class Repairer {
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
+    if (!empty && t.max_sequence == 0) {
+      // An ingested table.  Without its global seqno its entries would
+      // sort below everything they once replaced.
+      auto g = global_seqnos_.find(number);
+      if (g == global_seqnos_.end()) {
+        ArchiveFile(fname);
+        Log(options_.info_log,
+            "Table #%llu: dropped: ingested at an unknown sequence number",
+            (unsigned long long)t.meta.number);
+        return;
+      }
+      ApplyGlobalSeqno(g->second, &t);
+    }
+
     if (status.ok()) {
       tables_.push_back(t);
     } else {
@@ -291,6 +366,24 @@ class Repairer {
     }
   }
 
+  // Describe the ingested table "t" as it was added at "seqno".
+  static void ApplyGlobalSeqno(SequenceNumber seqno, TableInfo* t) {
+    ParsedInternalKey smallest, largest;
+    if (ParseInternalKey(t->meta.smallest.Encode(), &smallest) &&
+        ParseInternalKey(t->meta.largest.Encode(), &largest)) {
+      // Copy the user keys out of the keys about to be overwritten
+      const std::string smallest_user_key = smallest.user_key.ToString();
+      const std::string largest_user_key = largest.user_key.ToString();
+      t->meta.smallest.SetFrom(
+          ParsedInternalKey(smallest_user_key, seqno, smallest.type));
+      t->meta.largest.SetFrom(
+          ParsedInternalKey(largest_user_key, seqno, largest.type));
+    }
+    t->meta.smallest_seqno = seqno;
+    t->meta.global_seqno = seqno;
+    t->max_sequence = seqno;
+  }
+
   void RepairTable(const std::string& src, TableInfo t) {
     // We will copy src contents to a new table and then rename the
     // new table over the source.
@@ -317,6 +410,8 @@ class Repairer {
     if (counter == 0) {
       builder->Abandon();  // Nothing to save
     } else {
+      builder->SetInternalKeyProperties(
+          t.meta.num_deletions, t.meta.smallest_seqno, t.max_sequence);
       s = builder->Finish();
       if (s.ok()) {
         t.meta.file_size = builder->FileSize();
@@ -368,8 +463,9 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      FileMetaData meta = t.meta;
+      meta.largest_seqno = t.max_sequence;
+      edit_.AddFile(0, meta);
     }
 
     // fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -428,6 +524,7 @@ class Repairer {
   Env* const env_;
   InternalKeyComparator const icmp_;
   InternalFilterPolicy const ipolicy_;
+  InternalKeySliceTransform const iprefix_;
   const Options options_;
   bool owns_info_log_;
   bool owns_cache_;
@@ -438,6 +535,7 @@ class Repairer {
   std::vector<uint64_t> table_numbers_;
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
+  std::map<uint64_t, SequenceNumber> global_seqnos_;  // By table number
   uint64_t next_file_number_;
 };
 }  // namespace
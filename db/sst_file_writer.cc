@@ -0,0 +1,144 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// Entries are stored under internal keys with sequence number zero.
+// DB::IngestExternalFile() gives all of them a single sequence number
+// when it adds the file, without rewriting it.
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& opt)
+      : internal_comparator(opt.comparator),
+        internal_filter_policy(opt.filter_policy),
+        internal_prefix_extractor(opt.prefix_extractor),
+        options(opt),
+        file(nullptr),
+        builder(nullptr),
+        num_entries(0),
+        num_deletions(0),
+        file_size(0) {
+    options.comparator = &internal_comparator;
+    options.filter_policy =
+        (opt.filter_policy != nullptr) ? &internal_filter_policy : nullptr;
+    options.prefix_extractor = (opt.prefix_extractor != nullptr)
+                                   ? &internal_prefix_extractor
+                                   : nullptr;
+  }
+
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  const InternalKeySliceTransform internal_prefix_extractor;
+  Options options;
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // Last user key added
+  uint64_t num_entries;
+  uint64_t num_deletions;
+  uint64_t file_size;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    // Open() was called but Finish() was not
+    rep_->builder->Abandon();
+    delete rep_->builder;
+    delete rep_->file;
+    rep_->options.env->DeleteFile(rep_->fname);
+  }
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  if (r->builder != nullptr) {
+    return Status::InvalidArgument("file already open", r->fname);
+  }
+  Status s = r->options.env->NewWritableFile(fname, &r->file);
+  if (!s.ok()) {
+    return s;
+  }
+  r->fname = fname;
+  r->builder = new TableBuilder(r->options, r->file);
+  r->last_key.clear();
+  r->num_entries = 0;
+  r->num_deletions = 0;
+  r->file_size = 0;
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no file open");
+  }
+  if (r->num_entries > 0 &&
+      r->internal_comparator.user_comparator()->Compare(key, r->last_key) <=
+          0) {
+    return Status::InvalidArgument("keys must be added in increasing order");
+  }
+  InternalKey ikey(key, 0, deletion ? kTypeDeletion : kTypeValue);
+  r->builder->Add(ikey.Encode(), value);
+  Status s = r->builder->status();
+  if (s.ok()) {
+    r->last_key.assign(key.data(), key.size());
+    r->num_entries++;
+    if (deletion) {
+      r->num_deletions++;
+    }
+  }
+  return s;
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no file open");
+  }
+  // All entries are stored with sequence number zero (see above)
+  r->builder->SetInternalKeyProperties(r->num_deletions, 0, 0);
+  Status s = r->builder->Finish();
+  if (s.ok()) {
+    r->file_size = r->builder->FileSize();
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->builder;
+  r->builder = nullptr;
+  delete r->file;
+  r->file = nullptr;
+  if (!s.ok()) {
+    r->options.env->DeleteFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::NumEntries() const { return rep_->num_entries; }
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder != nullptr ? rep_->builder->FileSize()
+                                  : rep_->file_size;
+}
+
+}  // namespace leveldb
@@ -7,6 +7,7 @@
 #include "db/filename.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
+#include "leveldb/table_properties.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -29,6 +30,93 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+namespace {
+
+// Returns the entries of a table added by DB::IngestExternalFile(), which
+// are stored with sequence number zero, with the sequence number the
+// table was given when it was added.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(Iterator* iter, const Comparator* user_comparator,
+                      SequenceNumber seqno)
+      : iter_(iter), user_comparator_(user_comparator), seqno_(seqno) {}
+
+  ~GlobalSeqnoIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    UpdateKey();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    UpdateKey();
+  }
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    ParsedInternalKey parsed;
+    if (iter_->Valid() && ParseInternalKey(target, &parsed) &&
+        parsed.sequence < seqno_ &&
+        user_comparator_->Compare(ExtractUserKey(iter_->key()),
+                                  parsed.user_key) == 0) {
+      // The entry is newer than the target, so it sorts before it.
+      iter_->Next();
+    }
+    UpdateKey();
+  }
+  void Next() override {
+    iter_->Next();
+    UpdateKey();
+  }
+  void Prev() override {
+    iter_->Prev();
+    UpdateKey();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void UpdateKey() {
+    key_.clear();
+    if (iter_->Valid()) {
+      ParsedInternalKey parsed;
+      if (ParseInternalKey(iter_->key(), &parsed)) {
+        parsed.sequence = seqno_;
+        AppendInternalKey(&key_, parsed);
+      } else {
+        key_.assign(iter_->key().data(), iter_->key().size());
+      }
+    }
+  }
+
+  Iterator* const iter_;
+  const Comparator* const user_comparator_;
+  const SequenceNumber seqno_;
+  std::string key_;
+};
+
+struct GlobalSeqnoSaver {
+  SequenceNumber seqno;
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+};
+
+void SaveWithGlobalSeqno(void* arg, const Slice& k, const Slice& v) {
+  GlobalSeqnoSaver* saver = reinterpret_cast<GlobalSeqnoSaver*>(arg);
+  ParsedInternalKey parsed;
+  if (ParseInternalKey(k, &parsed)) {
+    parsed.sequence = saver->seqno;
+    std::string key;
+    AppendInternalKey(&key, parsed);
+    (*saver->handle_result)(saver->arg, key, v);
+  } else {
+    (*saver->handle_result)(saver->arg, k, v);
+  }
+}
+
+}  // namespace
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
@@ -39,13 +127,15 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
 TableCache::~TableCache() { delete cache_; }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
-                             Cache::Handle** handle) {
+                             bool no_io, Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
   Slice key(buf, sizeof(buf));
   *handle = cache_->Lookup(key);
-  if (*handle == nullptr) {
+  if (*handle == nullptr && no_io) {
+    s = Status::Incomplete("table is not open");
+  } else if (*handle == nullptr) {
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
@@ -77,19 +167,26 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number, uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr,
+                                  SequenceNumber global_seqno) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, options.no_io, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
   Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
   Iterator* result = table->NewIterator(options);
+  if (global_seqno != 0) {
+    const Comparator* ucmp =
+        static_cast<const InternalKeyComparator*>(options_.comparator)
+            ->user_comparator();
+    result = new GlobalSeqnoIterator(result, ucmp, global_seqno);
+  }
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
     *tableptr = table;
@@ -98,14 +195,66 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 }
 
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
-                       uint64_t file_size, const Slice& k, void* arg,
+                       uint64_t file_size, SequenceNumber global_seqno,
+                       const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       Iterator** value_pin) {
+  if (value_pin != nullptr) {
+    *value_pin = nullptr;
+  }
+  GlobalSeqnoSaver saver;
+  if (global_seqno != 0) {
+    ParsedInternalKey parsed;
+    if (ParseInternalKey(k, &parsed) && parsed.sequence < global_seqno) {
+      // Every entry in the file is too new to be seen
+      return Status::OK();
+    }
+    saver.seqno = global_seqno;
+    saver.arg = arg;
+    saver.handle_result = handle_result;
+    arg = &saver;
+    handle_result = &SaveWithGlobalSeqno;
+  }
+
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, options.no_io, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    s = t->InternalGet(options, k, arg, handle_result, value_pin);
+    if (value_pin != nullptr && *value_pin != nullptr) {
+      (*value_pin)->RegisterCleanup(&UnrefEntry, cache_, handle);
+    } else {
+      cache_->Release(handle);
+    }
+  }
+  return s;
+}
+
+bool TableCache::PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                                const Slice& target) {
+  Cache::Handle* handle = nullptr;
+  if (!FindTable(file_number, file_size, false, &handle).ok()) {
+    return true;  // Let the iterator over the file report the error
+  }
+  Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  bool may_match = t->PrefixMayMatch(target);
+  cache_->Release(handle);
+  return may_match;
+}
+
+Status TableCache::GetProperties(uint64_t file_number, uint64_t file_size,
+                                 TableProperties* props) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, false, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    const TableProperties* table_props = t->GetProperties();
+    if (table_props != nullptr) {
+      *props = *table_props;
+    } else {
+      s = Status::NotFound("table has no properties");
+    }
     cache_->Release(handle);
   }
   return s;
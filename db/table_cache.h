@@ -32,20 +32,44 @@ class TableCache {
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // If "global_seqno" is non-zero, the keys of the file are stored with
+  // sequence number zero (see DB::IngestExternalFile()) and are returned
+  // with sequence number "global_seqno" instead.
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, Table** tableptr = nullptr,
+                        SequenceNumber global_seqno = 0);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  "global_seqno"
+  // is interpreted as by NewIterator().  "value_pin" is interpreted as
+  // "block_iter" by Table::InternalGet(): the iterator also keeps the
+  // table open.
   Status Get(const ReadOptions& options, uint64_t file_number,
-             uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             uint64_t file_size, SequenceNumber global_seqno, const Slice& k,
+             void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             Iterator** value_pin = nullptr);
+
+  // Returns false only if the filters of the specified file show that no
+  // key at or after internal key "target" has the prefix of "target".
+  // See ReadOptions::prefix_same_as_start.
+  bool PrefixMayMatch(uint64_t file_number, uint64_t file_size,
+                      const Slice& target);
+
+  // Store the properties recorded in the specified file in *props.
+  // Returns NotFound if the file has none.
+  Status GetProperties(uint64_t file_number, uint64_t file_size,
+                       TableProperties* props);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  // Fails with Status::Incomplete() if the table is not open and "no_io"
+  // is set.
+  Status FindTable(uint64_t file_number, uint64_t file_size, bool no_io,
+                   Cache::Handle**);
 
   Env* const env_;
   const std::string dbname_;
@@ -0,0 +1,198 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/tailing_iter.h"
+
+#include <string>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "db/db_iter.h"
+#include "db/version_set.h"
+#include "table/merger.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Forwards to an iterator that it does not own, so that the iterator
+// can outlive the merging iterators that it is a child of.
+class UnownedIterator : public Iterator {
+ public:
+  explicit UnownedIterator(Iterator* iter) : iter_(iter) {}
+
+  bool Valid() const override { return iter_->Valid(); }
+  void SeekToFirst() override { iter_->SeekToFirst(); }
+  void SeekToLast() override { iter_->SeekToLast(); }
+  void Seek(const Slice& target) override { iter_->Seek(target); }
+  void Next() override { iter_->Next(); }
+  void Prev() override { iter_->Prev(); }
+  Slice key() const override { return iter_->key(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+  bool IsKeyPinned() const override { return iter_->IsKeyPinned(); }
+
+ private:
+  Iterator* const iter_;
+};
+
+void UnrefVersion(void* arg1, void* arg2) {
+  port::Mutex* mu = reinterpret_cast<port::Mutex*>(arg1);
+  Version* version = reinterpret_cast<Version*>(arg2);
+  mu->Lock();
+  version->Unref();
+  mu->Unlock();
+}
+
+}  // anonymous namespace
+
+// Iterates through a DBIter that is replaced whenever it may have missed
+// writes.  The replacement only reads the memtables and level-0 files
+// anew: the iterator over the files of levels > 0 (sorted_iter_) is
+// shared by all DBIters until a compaction changes those files.
+class TailingIterator : public Iterator {
+ public:
+  TailingIterator(DBImpl* db, const ReadOptions& options)
+      : db_(db),
+        options_(options),
+        sequence_(0),
+        sorted_version_(nullptr),
+        sorted_iter_(nullptr),
+        iter_(nullptr) {
+    // Every refresh reads the bounds again, so keep copies of them
+    if (options.iterate_lower_bound != nullptr) {
+      lower_bound_storage_ = options.iterate_lower_bound->ToString();
+      lower_bound_ = lower_bound_storage_;
+      options_.iterate_lower_bound = &lower_bound_;
+    }
+    if (options.iterate_upper_bound != nullptr) {
+      upper_bound_storage_ = options.iterate_upper_bound->ToString();
+      upper_bound_ = upper_bound_storage_;
+      options_.iterate_upper_bound = &upper_bound_;
+    }
+  }
+
+  TailingIterator(const TailingIterator&) = delete;
+  TailingIterator& operator=(const TailingIterator&) = delete;
+
+  ~TailingIterator() override {
+    delete iter_;
+    delete sorted_iter_;
+  }
+
+  bool Valid() const override { return iter_ != nullptr && iter_->Valid(); }
+  Slice key() const override { return iter_->key(); }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override {
+    if (!status_.ok() || iter_ == nullptr) {
+      return status_;
+    }
+    return iter_->status();
+  }
+
+  void Next() override;
+  void Seek(const Slice& target) override;
+  void SeekToFirst() override;
+  void Prev() override { NotSupported("Prev()"); }
+  void SeekToLast() override { NotSupported("SeekToLast()"); }
+
+ private:
+  bool Refresh();
+  void NotSupported(const char* operation);
+
+  DBImpl* const db_;
+  ReadOptions options_;
+  std::string lower_bound_storage_;
+  std::string upper_bound_storage_;
+  Slice lower_bound_;
+  Slice upper_bound_;
+  Status status_;
+
+  SequenceNumber sequence_;   // Sequence number iter_ reads at
+  Version* sorted_version_;   // Version whose files sorted_iter_ reads
+  Iterator* sorted_iter_;     // Iterator over levels > 0 of sorted_version_
+  Iterator* iter_;            // DBIter over memtables, level 0, sorted_iter_
+  std::string last_key_;      // Key iter_ was at before the last Next()
+};
+
+// Replaces iter_ if anything was written since it was created.  Returns
+// true iff iter_ was replaced; the new iter_ is not positioned.
+bool TailingIterator::Refresh() {
+  Iterator* obsolete_sorted_iter = nullptr;
+  Iterator* children[2];
+  uint32_t seed;
+  {
+    MutexLock l(&db_->mutex_);
+    VersionSet* versions = db_->versions_;
+    if (iter_ != nullptr && sequence_ == versions->LastSequence()) {
+      return false;
+    }
+    sequence_ = versions->LastSequence();
+
+    Version* current = versions->current();
+    if (sorted_iter_ == nullptr || !current->SameFiles(sorted_version_, 1)) {
+      obsolete_sorted_iter = sorted_iter_;
+      std::vector<Iterator*> list;
+      current->AddIterators(options_, 1, config::kNumLevels - 1, &list);
+      sorted_iter_ = NewMergingIterator(&db_->internal_comparator_,
+                                        list.data(), list.size());
+      current->Ref();
+      sorted_iter_->RegisterCleanup(&UnrefVersion, &db_->mutex_, current);
+      sorted_version_ = current;
+    }
+    children[0] = db_->NewInternalIterator(options_, 0);
+    children[1] = new UnownedIterator(sorted_iter_);
+    seed = ++db_->seed_;
+  }
+
+  // Deleting iterators takes the mutex
+  delete iter_;
+  delete obsolete_sorted_iter;
+  iter_ = NewDBIterator(
+      db_, db_->user_comparator(), db_->options_.merge_operator,
+      db_->IteratorPrefixExtractor(options_),
+      options_.iterate_lower_bound, options_.iterate_upper_bound,
+      NewMergingIterator(&db_->internal_comparator_, children, 2), sequence_,
+      db_->options_.read_sampling_period, seed);
+  return true;
+}
+
+void TailingIterator::NotSupported(const char* operation) {
+  status_ = Status::NotSupported(operation, "tailing iterator");
+  delete iter_;
+  iter_ = nullptr;
+}
+
+void TailingIterator::Next() {
+  assert(Valid());
+  last_key_.assign(iter_->key().data(), iter_->key().size());
+  iter_->Next();
+  if (!iter_->Valid() && iter_->status().ok() && Refresh()) {
+    // Pick up after the last key in the new state of the database
+    iter_->Seek(last_key_);
+    if (iter_->Valid() &&
+        db_->user_comparator()->Compare(iter_->key(), last_key_) == 0) {
+      iter_->Next();
+    }
+  }
+}
+
+void TailingIterator::Seek(const Slice& target) {
+  status_ = Status::OK();
+  Refresh();
+  iter_->Seek(target);
+}
+
+void TailingIterator::SeekToFirst() {
+  status_ = Status::OK();
+  Refresh();
+  iter_->SeekToFirst();
+}
+
+Iterator* NewTailingIterator(DBImpl* db, const ReadOptions& options) {
+  return new TailingIterator(db, options);
+}
+
+}  // namespace leveldb
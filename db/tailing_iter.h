@@ -0,0 +1,21 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_TAILING_ITER_H_
+#define STORAGE_LEVELDB_DB_TAILING_ITER_H_
+
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+
+namespace leveldb {
+
+class DBImpl;
+
+// Return a new iterator over the latest state of "*db" that is refreshed
+// as described for ReadOptions::tailing.
+Iterator* NewTailingIterator(DBImpl* db, const ReadOptions& options);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TAILING_ITER_H_
@@ -20,7 +20,25 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  // Like kNewFile, followed by a list of (field tag, length-prefixed value)
+  // pairs ended by kTerminate.  Readers skip fields they do not know, but
+  // versions older than this tag cannot read it at all, so it is only used
+  // for files that need one of the fields.  Level-0 files always do: their
+  // order comes from their sequence numbers.  This format break is
+  // intended; descriptors with no level-0 or ingested files, and none of
+  // the optional metadata in use, stay readable by older versions.
+  kNewFile2 = 10
+};
+
+// Field tags for kNewFile2 entries.  These numbers are written to disk and
+// should not be changed.
+enum NewFileField {
+  kTerminate = 1,
+  kSequenceRange = 2,
+  kCreationTime = 3,
+  kEntryCounts = 4,
+  kGlobalSeqno = 5
 };
 
 void VersionEdit::Clear() {
@@ -38,7 +56,7 @@ void VersionEdit::Clear() {
   new_files_.clear();
 }
 
-void VersionEdit::EncodeTo(std::string* dst) const {
+void VersionEdit::EncodeTo(std::string* dst, int file_fields) const {
   if (has_comparator_) {
     PutVarint32(dst, kComparator);
     PutLengthPrefixedSlice(dst, comparator_);
@@ -73,13 +91,50 @@ void VersionEdit::EncodeTo(std::string* dst) const {
   }
 
   for (size_t i = 0; i < new_files_.size(); i++) {
+    const int level = new_files_[i].first;
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
-    PutVarint32(dst, new_files_[i].first);  // level
+    // Once the new encoding is needed, the other fields come for free.
+    const bool has_fields =
+        (f.largest_seqno != 0 &&
+         (level == 0 || (file_fields & kFileSequenceRange))) ||
+        (f.creation_time != 0 && (file_fields & kFileCreationTime)) ||
+        (f.num_entries != 0 && (file_fields & kFileEntryCounts)) ||
+        f.global_seqno != 0;
+    PutVarint32(dst, has_fields ? kNewFile2 : kNewFile);
+    PutVarint32(dst, level);
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (has_fields) {
+      std::string field;
+      if (f.largest_seqno != 0) {
+        PutVarint64(&field, f.smallest_seqno);
+        PutVarint64(&field, f.largest_seqno);
+        PutVarint32(dst, kSequenceRange);
+        PutLengthPrefixedSlice(dst, field);
+      }
+      if (f.creation_time != 0) {
+        field.clear();
+        PutVarint64(&field, f.creation_time);
+        PutVarint32(dst, kCreationTime);
+        PutLengthPrefixedSlice(dst, field);
+      }
+      if (f.num_entries != 0) {
+        field.clear();
+        PutVarint64(&field, f.num_entries);
+        PutVarint64(&field, f.num_deletions);
+        PutVarint32(dst, kEntryCounts);
+        PutLengthPrefixedSlice(dst, field);
+      }
+      if (f.global_seqno != 0) {
+        field.clear();
+        PutVarint64(&field, f.global_seqno);
+        PutVarint32(dst, kGlobalSeqno);
+        PutLengthPrefixedSlice(dst, field);
+      }
+      PutVarint32(dst, kTerminate);
+    }
   }
 }
 
@@ -92,6 +147,52 @@ static bool GetInternalKey(Slice* input, InternalKey* dst) {
   }
 }
 
+// Parse the fields that follow a kNewFile2 entry into *f.
+static bool GetNewFileFields(Slice* input, FileMetaData* f) {
+  uint32_t field;
+  Slice value;
+  while (GetVarint32(input, &field)) {
+    if (field == kTerminate) {
+      return true;
+    }
+    if (!GetLengthPrefixedSlice(input, &value)) {
+      return false;
+    }
+    switch (field) {
+      case kSequenceRange:
+        if (!GetVarint64(&value, &f->smallest_seqno) ||
+            !GetVarint64(&value, &f->largest_seqno)) {
+          return false;
+        }
+        break;
+
+      case kCreationTime:
+        if (!GetVarint64(&value, &f->creation_time)) {
+          return false;
+        }
+        break;
+
+      case kEntryCounts:
+        if (!GetVarint64(&value, &f->num_entries) ||
+            !GetVarint64(&value, &f->num_deletions)) {
+          return false;
+        }
+        break;
+
+      case kGlobalSeqno:
+        if (!GetVarint64(&value, &f->global_seqno)) {
+          return false;
+        }
+        break;
+
+      default:
+        // Written by a newer version; safe to ignore.
+        break;
+    }
+  }
+  return false;
+}
+
 static bool GetLevel(Slice* input, int* level) {
   uint32_t v;
   if (GetVarint32(input, &v) && v < config::kNumLevels) {
@@ -175,10 +276,13 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFile2:
+        f = FileMetaData();
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
-            GetInternalKey(&input, &f.largest)) {
+            GetInternalKey(&input, &f.largest) &&
+            (tag == kNewFile || GetNewFileFields(&input, &f))) {
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -249,6 +353,26 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.largest_seqno != 0) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.smallest_seqno);
+      r.append(" .. ");
+      AppendNumberTo(&r, f.largest_seqno);
+    }
+    if (f.creation_time != 0) {
+      r.append(" created ");
+      AppendNumberTo(&r, f.creation_time);
+    }
+    if (f.num_entries != 0) {
+      r.append(" entries ");
+      AppendNumberTo(&r, f.num_entries);
+      r.append(" deletions ");
+      AppendNumberTo(&r, f.num_deletions);
+    }
+    if (f.global_seqno != 0) {
+      r.append(" global seq ");
+      AppendNumberTo(&r, f.global_seqno);
+    }
   }
   r.append("\n}\n");
   return r;
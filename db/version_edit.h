@@ -16,7 +16,16 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        smallest_seqno(0),
+        largest_seqno(0),
+        creation_time(0),
+        num_entries(0),
+        num_deletions(0),
+        global_seqno(0) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -24,6 +33,21 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  // Range of sequence numbers in the table.  Both are zero for tables
+  // recorded by versions of leveldb that did not track them.
+  SequenceNumber smallest_seqno;
+  SequenceNumber largest_seqno;
+  // Time at which the oldest data in the table was written, in seconds
+  // since the epoch.  Zero if unknown.
+  uint64_t creation_time;
+  // Number of entries in the table and how many of them are deletion
+  // markers.  Both are zero if unknown.
+  uint64_t num_entries;
+  uint64_t num_deletions;
+  // Sequence number of every entry in a table added by
+  // DB::IngestExternalFile(), whose keys are stored with sequence number
+  // zero.  Zero for tables whose keys carry their own sequence numbers.
+  SequenceNumber global_seqno;
 };
 
 /*
@@ -77,12 +101,44 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by "f" at the specified level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  void AddFile(int level, const FileMetaData& f) {
+    FileMetaData copy;
+    copy.number = f.number;
+    copy.file_size = f.file_size;
+    copy.smallest = f.smallest;
+    copy.largest = f.largest;
+    copy.smallest_seqno = f.smallest_seqno;
+    copy.largest_seqno = f.largest_seqno;
+    copy.creation_time = f.creation_time;
+    copy.num_entries = f.num_entries;
+    copy.num_deletions = f.num_deletions;
+    copy.global_seqno = f.global_seqno;
+    new_files_.push_back(std::make_pair(level, copy));
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
   }
 
-  void EncodeTo(std::string* dst) const;
+  // The files added by this edit, with their levels.
+  const std::vector<std::pair<int, FileMetaData> >& new_files() const {
+    return new_files_;
+  }
+
+  // Optional metadata of the new files that make EncodeTo() write them in
+  // the extended encoding, which then records all their metadata.  Level-0
+  // files with a sequence range and ingested files always need it.
+  enum FileFields {
+    kFileSequenceRange = 1 << 0,  // Of files above level-0
+    kFileCreationTime = 1 << 1,
+    kFileEntryCounts = 1 << 2,
+    kAllFileFields = kFileSequenceRange | kFileCreationTime | kFileEntryCounts
+  };
+
+  void EncodeTo(std::string* dst, int file_fields = kAllFileFields) const;
   Status DecodeFrom(const Slice& src);
 
   std::string DebugString() const;
@@ -39,6 +39,76 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, EncodeDecodeFileFields) {
+  static const uint64_t kBig = 1ull << 50;
+
+  FileMetaData f;
+  f.number = kBig + 1;
+  f.file_size = kBig + 2;
+  f.smallest = InternalKey("foo", kBig + 3, kTypeValue);
+  f.largest = InternalKey("zoo", kBig + 4, kTypeDeletion);
+  f.smallest_seqno = kBig + 3;
+  f.largest_seqno = kBig + 5;
+
+  VersionEdit edit;
+  edit.AddFile(2, f);
+  edit.AddFile(3, kBig + 6, kBig + 7, f.smallest, f.largest);
+  FileMetaData g;
+  g.number = kBig + 8;
+  g.smallest = f.smallest;
+  g.largest = f.largest;
+  g.creation_time = 1600000000;
+  g.num_entries = 300;
+  g.num_deletions = 200;
+  edit.AddFile(4, g);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  std::string debug = parsed.DebugString();
+  ASSERT_NE(std::string::npos, debug.find("seq 1125899906842627 .. "
+                                          "1125899906842629"))
+      << debug;
+  ASSERT_NE(std::string::npos, debug.find("created 1600000000")) << debug;
+  ASSERT_NE(std::string::npos, debug.find("entries 300 deletions 200"))
+      << debug;
+}
+
+TEST(VersionEditTest, EncodeOnlyNeededFileFields) {
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 100;
+  f.smallest = InternalKey("foo", 3, kTypeValue);
+  f.largest = InternalKey("zoo", 4, kTypeValue);
+  f.smallest_seqno = 3;
+  f.largest_seqno = 4;
+  f.creation_time = 1600000000;
+  f.num_entries = 2;
+
+  // Above level-0 the file keeps the original encoding.
+  VersionEdit edit, plain;
+  edit.AddFile(1, f);
+  plain.AddFile(1, f.number, f.file_size, f.smallest, f.largest);
+  std::string encoded, plain_encoded;
+  edit.EncodeTo(&encoded, 0);
+  plain.EncodeTo(&plain_encoded);
+  ASSERT_EQ(plain_encoded, encoded);
+
+  // The sequence range orders level-0 files, so it is always written,
+  // along with the rest.
+  VersionEdit level0;
+  level0.AddFile(0, f);
+  encoded.clear();
+  level0.EncodeTo(&encoded, 0);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  std::string debug = parsed.DebugString();
+  ASSERT_NE(std::string::npos, debug.find("seq 3 .. 4")) << debug;
+  ASSERT_NE(std::string::npos, debug.find("created 1600000000")) << debug;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -7,6 +7,7 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <limits>
 
 #include "db/filename.h"
 #include "db/log_reader.h"
@@ -14,6 +15,7 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
@@ -50,23 +52,66 @@ static double MaxBytesForLevel(const Options* options, int level) {
   // Result for both level-0 and level-1
   /*
   1. 0级文件没有使用这个函数，0级文件总大小不受限制，受文件个数的限制。
-  2. level层级文件的总大小：
+  2. level层级文件的总大小（默认参数下）：
       level 1: 10M
       level 2: 100M
       level 3: 1000M
       ....
   */
-  double result = 10. * 1048576.0;
+  double result = static_cast<double>(options->max_bytes_for_level_base);
   while (level > 1) {
-    result *= 10;
+    result *= options->max_bytes_for_level_multiplier;
     level--;
   }
   return result;
 }
 
 static uint64_t MaxFileSizeForLevel(const Options* options, int level) {
-  // We could vary per level to reduce number of files?
-  return TargetFileSize(options);
+  if (options->compaction_style == kCompactionStyleUniversal) {
+    // Each sorted run is kept in a single file.
+    return std::numeric_limits<uint64_t>::max();
+  }
+  // Deeper levels hold more data, so give them larger files.
+  uint64_t result = TargetFileSize(options);
+  while (level > 1) {
+    result *= options->max_file_size_multiplier;
+    level--;
+  }
+  return result;
+}
+
+// Under kCompactionStyleFIFO, has file "f" outlived options->fifo_ttl at
+// time "now" (in seconds since the epoch)?
+static bool IsExpired(const Options* options, const FileMetaData* f,
+                      uint64_t now) {
+  return options->fifo_ttl > 0 && f->creation_time != 0 &&
+         f->creation_time + options->fifo_ttl <= now;
+}
+
+// Under kCompactionStyleLevel, should file "f" be compacted because of
+// its deletion markers or its age at time "now"?
+static bool NeedsMarkedCompaction(const Options* options,
+                                  const FileMetaData* f, uint64_t now) {
+  if (options->deletion_compaction_ratio > 0 && f->num_entries > 0 &&
+      f->num_deletions >=
+          options->deletion_compaction_ratio * f->num_entries) {
+    return true;
+  }
+  return options->max_file_age > 0 && f->creation_time != 0 &&
+         f->creation_time + options->max_file_age <= now;
+}
+
+// The optional file metadata that "options" make use of.  Leaving out the
+// rest keeps files above level-0 in the original descriptor encoding.
+static int FileFieldsInUse(const Options* options) {
+  int fields = 0;
+  if (options->fifo_ttl > 0 || options->max_file_age > 0) {
+    fields |= VersionEdit::kFileCreationTime;
+  }
+  if (options->deletion_compaction_ratio > 0) {
+    fields |= VersionEdit::kFileEntryCounts;
+  }
+  return fields;
 }
 
 static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
@@ -171,30 +216,39 @@ bool SomeFileOverlapsRange(const InternalKeyComparator& icmp,
 // An internal iterator.  For a given version/level pair, yields
 // information about the files in the level.  For a given entry, key()
 // is the largest key that occurs in the file, and value() is an
-// 16-byte value containing the file number and file size, both
-// encoded using EncodeFixed64.
+// 24-byte value containing the file number, file size and global
+// sequence number, all encoded using EncodeFixed64.
+//
+// The iterator may be restricted to the files [begin,end) of the level.
 class Version::LevelFileNumIterator : public Iterator {
  public:
   LevelFileNumIterator(const InternalKeyComparator& icmp,
                        const std::vector<FileMetaData*>* flist)
-      : icmp_(icmp), flist_(flist), index_(flist->size()) {  // Marks as invalid
-  }
-  bool Valid() const override { return index_ < flist_->size(); }
+      : LevelFileNumIterator(icmp, flist, 0, flist->size()) {}
+  LevelFileNumIterator(const InternalKeyComparator& icmp,
+                       const std::vector<FileMetaData*>* flist,
+                       uint32_t begin, uint32_t end)
+      : icmp_(icmp),
+        flist_(flist),
+        begin_(begin),
+        end_(end),
+        index_(end) {  // Marks as invalid
+  }
+  bool Valid() const override { return index_ < end_; }
   void Seek(const Slice& target) override {
-    index_ = FindFile(icmp_, *flist_, target);
-  }
-  void SeekToFirst() override { index_ = 0; }
-  void SeekToLast() override {
-    index_ = flist_->empty() ? 0 : flist_->size() - 1;
+    index_ = std::max<uint32_t>(FindFile(icmp_, *flist_, target), begin_);
+    if (index_ > end_) index_ = end_;
   }
+  void SeekToFirst() override { index_ = begin_; }
+  void SeekToLast() override { index_ = (begin_ == end_) ? end_ : end_ - 1; }
   void Next() override {
     assert(Valid());
     index_++;
   }
   void Prev() override {
     assert(Valid());
-    if (index_ == 0) {
-      index_ = flist_->size();  // Marks as invalid
+    if (index_ == begin_) {
+      index_ = end_;  // Marks as invalid
     } else {
       index_--;
     }
@@ -207,6 +261,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
@@ -214,49 +269,111 @@ class Version::LevelFileNumIterator : public Iterator {
  private:
   const InternalKeyComparator icmp_;
   const std::vector<FileMetaData*>* const flist_;
+  const uint32_t begin_;
+  const uint32_t end_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8), nullptr,
+                              DecodeFixed64(file_value.data() + 16));
+  }
+}
+
+static bool FilePrefixMayMatch(void* arg, const Slice& file_value,
+                               const Slice& target) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 24) {
+    return true;  // GetFileIterator() reports the corruption
   }
+  return cache->PrefixMayMatch(DecodeFixed64(file_value.data()),
+                               DecodeFixed64(file_value.data() + 8), target);
+}
+
+// Is "f" entirely outside the iterate bounds of "options"?
+static bool FileOutsideBounds(const Comparator* ucmp,
+                              const ReadOptions& options,
+                              const FileMetaData* f) {
+  return (options.iterate_upper_bound != nullptr &&
+          ucmp->Compare(f->smallest.user_key(), *options.iterate_upper_bound) >=
+              0) ||
+         (options.iterate_lower_bound != nullptr &&
+          ucmp->Compare(f->largest.user_key(), *options.iterate_lower_bound) <
+              0);
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  const std::vector<FileMetaData*>& files = files_[level];
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  uint32_t begin = 0;
+  uint32_t end = files.size();
+  if (options.iterate_lower_bound != nullptr) {
+    InternalKey lower(*options.iterate_lower_bound, kMaxSequenceNumber,
+                      kValueTypeForSeek);
+    begin = FindFile(vset_->icmp_, files, lower.Encode());
+  }
+  if (options.iterate_upper_bound != nullptr) {
+    while (end > begin && FileOutsideBounds(ucmp, options, files[end - 1])) {
+      end--;
+    }
+  }
   return NewTwoLevelIterator(
-      new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
-      vset_->table_cache_, options);
+      new LevelFileNumIterator(vset_->icmp_, &files, begin, end),
+      &GetFileIterator, vset_->table_cache_, options, &FilePrefixMayMatch);
 }
 
 void Version::AddIterators(const ReadOptions& options,
                            std::vector<Iterator*>* iters) {
+  AddIterators(options, 0, config::kNumLevels - 1, iters);
+}
+
+void Version::AddIterators(const ReadOptions& options, int first_level,
+                           int last_level, std::vector<Iterator*>* iters) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
   // Merge all level zero files together since they may overlap
-  for (size_t i = 0; i < files_[0].size(); i++) {
-    iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+  if (first_level == 0) {
+    for (size_t i = 0; i < files_[0].size(); i++) {
+      if (FileOutsideBounds(ucmp, options, files_[0][i])) {
+        continue;
+      }
+      iters->push_back(vset_->table_cache_->NewIterator(
+          options, files_[0][i]->number, files_[0][i]->file_size, nullptr,
+          files_[0][i]->global_seqno));
+    }
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
-  for (int level = 1; level < config::kNumLevels; level++) {
+  for (int level = std::max(first_level, 1); level <= last_level; level++) {
     if (!files_[level].empty()) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
   }
 }
 
+bool Version::SameFiles(const Version* other, int first_level) const {
+  for (int level = first_level; level < config::kNumLevels; level++) {
+    if (files_[level] != other->files_[level]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -264,12 +381,13 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  Slice value;  // Valid while the block that holds it is
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -279,15 +397,30 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+      switch (parsed_key.type) {
+        case kTypeValue:
+          s->state = kFound;
+          s->value = v;
+          break;
+        case kTypeDeletion:
+          s->state = kDeleted;
+          break;
+        case kTypeMerge:
+          s->state = kMerge;
+          break;
       }
     }
   }
 }
 
+// Orders level-0 files by the newest data they hold.  A compaction that
+// writes back into level-0 can produce a file numbered after files holding
+// newer data, so the file number alone is not enough.  Files whose sequence
+// numbers are unknown predate all the files that record them.
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  if (a->largest_seqno != b->largest_seqno) {
+    return a->largest_seqno > b->largest_seqno;
+  }
   return a->number > b->number;
 }
 
@@ -297,19 +430,11 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   const Comparator* ucmp = vset_->icmp_.user_comparator();
 
   // Search level-0 in order from newest to oldest.
-  std::vector<FileMetaData*> tmp;
-  tmp.reserve(files_[0].size());
   for (uint32_t i = 0; i < files_[0].size(); i++) {
     FileMetaData* f = files_[0][i];
     if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
         ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
-      tmp.push_back(f);
-    }
-  }
-  if (!tmp.empty()) {
-    std::sort(tmp.begin(), tmp.end(), NewestFirst);
-    for (uint32_t i = 0; i < tmp.size(); i++) {
-      if (!(*func)(arg, 0, tmp[i])) {
+      if (!(*func)(arg, 0, f)) {
         return;
       }
     }
@@ -335,8 +460,54 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   }
 }
 
+static void DeleteIterator(void* arg1, void* arg2) {
+  delete reinterpret_cast<Iterator*>(arg1);
+}
+
+// Called when the first entry for saver->user_key in file "f" at or before
+// "ikey" is a merge operand.  Walks the entries for the key, appending the
+// operands to *merge_operands, and sets saver->state according to what
+// ends the chain.  A value that ends it is pinned in *value.
+static Status GetMergeOperands(TableCache* table_cache,
+                               const ReadOptions& options, FileMetaData* f,
+                               const Slice& ikey, Saver* saver,
+                               PinnableSlice* value,
+                               std::vector<std::string>* merge_operands) {
+  Iterator* iter = table_cache->NewIterator(options, f->number, f->file_size,
+                                            nullptr, f->global_seqno);
+  saver->state = kNotFound;
+  for (iter->Seek(ikey); iter->Valid(); iter->Next()) {
+    ParsedInternalKey parsed_key;
+    if (!ParseInternalKey(iter->key(), &parsed_key)) {
+      saver->state = kCorrupt;
+      break;
+    }
+    if (saver->ucmp->Compare(parsed_key.user_key, saver->user_key) != 0) {
+      break;
+    }
+    if (parsed_key.type == kTypeMerge) {
+      merge_operands->push_back(iter->value().ToString());
+      continue;
+    }
+    if (parsed_key.type == kTypeValue) {
+      saver->state = kFound;
+    } else {
+      saver->state = kDeleted;
+    }
+    break;
+  }
+  Status s = iter->status();
+  if (s.ok() && saver->state == kFound) {
+    value->PinSlice(iter->value(), &DeleteIterator, iter, nullptr);
+  } else {
+    delete iter;
+  }
+  return s;
+}
+
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    PinnableSlice* value, GetStats* stats,
+                    std::vector<std::string>* merge_operands) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -350,31 +521,16 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   // We can search level-by-level since entries never hop across
   // levels.  Therefore we are guaranteed that if we find data
   // in a smaller level, later levels are irrelevant.
-  std::vector<FileMetaData*> tmp;
   FileMetaData* tmp2;
   for (int level = 0; level < config::kNumLevels; level++) {
     size_t num_files = files_[level].size();
     if (num_files == 0) continue;
 
-    // Get the list of files to search in this level
+    // Get the list of files to search in this level.  Level-0 files may
+    // overlap each other; they are kept in order from newest to oldest and
+    // the loop below skips the ones that do not overlap user_key.
     FileMetaData* const* files = &files_[level][0];
-    if (level == 0) {
-      // Level-0 files may overlap each other.  Find all files that
-      // overlap user_key and process them in order from newest to oldest.
-      tmp.reserve(num_files);
-      for (uint32_t i = 0; i < num_files; i++) {
-        FileMetaData* f = files[i];
-        if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
-            ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
-          tmp.push_back(f);
-        }
-      }
-      if (tmp.empty()) continue;
-
-      std::sort(tmp.begin(), tmp.end(), NewestFirst);
-      files = &tmp[0];
-      num_files = tmp.size();
-    } else {
+    if (level > 0) {
       // Binary search to find earliest index whose largest key >= ikey.
       uint32_t index = FindFile(vset_->icmp_, files_[level], ikey);
       if (index >= num_files) {
@@ -387,20 +543,33 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
           files = nullptr;
           num_files = 0;
         } else {
-          files = &tmp2;
-          num_files = 1;
+          files = &files_[level][index];
+          num_files -= index;
         }
       }
     }
 
     for (uint32_t i = 0; i < num_files; ++i) {
+      FileMetaData* f = files[i];
+      if (level == 0 &&
+          (ucmp->Compare(user_key, f->smallest.user_key()) < 0 ||
+           ucmp->Compare(user_key, f->largest.user_key()) > 0)) {
+        continue;
+      }
+      if (level > 0 && i > 0 &&
+          ucmp->Compare(user_key, f->smallest.user_key()) != 0) {
+        // Only an unresolved merge chain gets here.  It continues into
+        // the next file if a compaction cut its output between the
+        // operands and the entries below them.
+        break;
+      }
+
       if (last_file_read != nullptr && stats->seek_file == nullptr) {
         // We have had more than one seek for this read.  Charge the 1st file.
         stats->seek_file = last_file_read;
         stats->seek_file_level = last_file_read_level;
       }
 
-      FileMetaData* f = files[i];
       last_file_read = f;
       last_file_read_level = level;
 
@@ -408,9 +577,20 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       saver.state = kNotFound;
       saver.ucmp = ucmp;
       saver.user_key = user_key;
-      saver.value = value;
-      s = vset_->table_cache_->Get(options, f->number, f->file_size, ikey,
-                                   &saver, SaveValue);
+      Iterator* value_pin;
+      s = vset_->table_cache_->Get(options, f->number, f->file_size,
+                                   f->global_seqno, ikey, &saver, SaveValue,
+                                   &value_pin);
+      if (s.ok() && saver.state == kFound) {
+        // Keep the block that holds the value instead of copying it
+        value->PinSlice(saver.value, &DeleteIterator, value_pin, nullptr);
+      } else {
+        delete value_pin;
+      }
+      if (s.ok() && saver.state == kMerge) {
+        s = GetMergeOperands(vset_->table_cache_, options, f, ikey, &saver,
+                             value, merge_operands);
+      }
       if (!s.ok()) {
         return s;
       }
@@ -425,6 +605,9 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
         case kCorrupt:
           s = Status::Corruption("corrupted key for ", user_key);
           return s;
+        case kMerge:
+          assert(false);  // Resolved by GetMergeOperands() above
+          break;
       }
     }
   }
@@ -436,7 +619,10 @@ bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
     f->allowed_seeks--;
-    if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr) {
+    // Seek compactions push a file down a level, which only the leveled
+    // compaction style does.
+    if (f->allowed_seeks <= 0 && file_to_compact_ == nullptr &&
+        vset_->options_->compaction_style == kCompactionStyleLevel) {
       file_to_compact_ = f;
       file_to_compact_level_ = stats.seek_file_level;
       return true;
@@ -503,7 +689,13 @@ bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
-  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+  // With dynamic level sizes the levels above the base level must stay
+  // empty; level-0 compactions move non-overlapping files down instead.
+  // Universal compaction keeps every file in level-0.
+  const Options* options = vset_->options_;
+  if (options->compaction_style == kCompactionStyleLevel &&
+      !options->level_compaction_dynamic_level_bytes &&
+      !OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
@@ -527,6 +719,26 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+int Version::PickLevelForExternalFile(const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) {
+  const Options* options = vset_->options_;
+  if (options->compaction_style != kCompactionStyleLevel) {
+    return 0;
+  }
+  int result = 0;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    if (OverlapInLevel(level, &smallest_user_key, &largest_user_key)) {
+      break;
+    }
+    // With dynamic level sizes the levels above the base level stay empty.
+    if (level == 0 || !options->level_compaction_dynamic_level_bytes ||
+        level >= base_level_) {
+      result = level;
+    }
+  }
+  return result;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -734,6 +946,19 @@ class VersionSet::Builder {
       std::vector<FileMetaData*>::const_iterator base_end = base_files.end();
       const FileSet* added_files = levels_[level].added_files;
       v->files_[level].reserve(base_files.size() + added_files->size());
+      if (level == 0) {
+        // Level-0 files are kept newest first rather than by smallest key,
+        // so that lookups can stop at the first file holding the key.
+        // Collect the surviving files and sort them instead of merging.
+        for (; base_iter != base_end; ++base_iter) {
+          MaybeAddFile(v, level, *base_iter);
+        }
+        for (const auto& added_file : *added_files) {
+          MaybeAddFile(v, level, added_file);
+        }
+        std::sort(v->files_[0].begin(), v->files_[0].end(), NewestFirst);
+        continue;
+      }
       for (const auto& added_file : *added_files) {
         // Add all smaller files listed in base_
         for (std::vector<FileMetaData*>::const_iterator bpos =
@@ -875,7 +1100,7 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     // Write new record to MANIFEST log
     if (s.ok()) {
       std::string record;
-      edit->EncodeTo(&record);
+      edit->EncodeTo(&record, FileFieldsInUse(options_));
       s = descriptor_log_->AddRecord(record);
       if (s.ok()) {
         s = descriptor_file_->Sync();
@@ -1077,7 +1302,74 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
   }
 }
 
+void VersionSet::ComputeLevelTargets(Version* v) {
+  if (!options_->level_compaction_dynamic_level_bytes) {
+    v->base_level_ = 1;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      v->max_bytes_for_level_[level] = MaxBytesForLevel(options_, level);
+    }
+    return;
+  }
+
+  int first_non_empty_level = -1;
+  int64_t max_level_bytes = 0;
+  for (int level = 1; level < config::kNumLevels; level++) {
+    if (first_non_empty_level < 0 && !v->files_[level].empty()) {
+      first_non_empty_level = level;
+    }
+    max_level_bytes = std::max(max_level_bytes, TotalFileSize(v->files_[level]));
+  }
+
+  // Work upwards from the last level, which should hold the bulk of the
+  // data, until the target drops to max_bytes_for_level_base.  Level-0 is
+  // compacted into the base level, so it may not lie below a non-empty
+  // level.
+  const int multiplier = options_->max_bytes_for_level_multiplier;
+  const double base_bytes = options_->max_bytes_for_level_base;
+  int base_level = config::kNumLevels - 1;
+  double level_bytes = max_level_bytes;
+  while (base_level > 1 &&
+         (level_bytes > base_bytes ||
+          (first_non_empty_level > 0 && base_level > first_non_empty_level))) {
+    base_level--;
+    level_bytes /= multiplier;
+  }
+  level_bytes = std::max(level_bytes, base_bytes / multiplier);
+
+  v->base_level_ = base_level;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    // Levels above the base level are empty; their targets are never used.
+    v->max_bytes_for_level_[level] = level_bytes;
+    if (level >= base_level) {
+      level_bytes *= multiplier;
+    }
+  }
+}
+
 void VersionSet::Finalize(Version* v) {
+  ComputeLevelTargets(v);
+
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    // Only level-0 is used, and it needs a compaction as soon as the
+    // oldest file has to be dropped.  Expiry is noticed whenever a new
+    // version is installed, e.g. after every memtable compaction.  Tables
+    // that fill the size limit exactly are kept, as in PickFIFOCompaction().
+    const std::vector<FileMetaData*>& files = v->files_[0];
+    const uint64_t total_bytes = TotalFileSize(files);
+    double score = static_cast<double>(total_bytes) /
+                   options_->fifo_max_table_files_size;
+    if (total_bytes <= options_->fifo_max_table_files_size) {
+      score = std::min(score, 0.99);
+    }
+    if (!files.empty() && IsExpired(options_, files.back(),
+                                    options_->env->NowMicros() / 1000000)) {
+      score = std::max(score, 1.0);
+    }
+    v->compaction_level_ = 0;
+    v->compaction_score_ = score;
+    return;
+  }
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
@@ -1101,8 +1393,7 @@ void VersionSet::Finalize(Version* v) {
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
+      score = static_cast<double>(level_bytes) / v->max_bytes_for_level_[level];
     }
 
     if (score > best_score) {
@@ -1113,6 +1404,23 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Look for a file to compact regardless of level sizes.  Files in the
+  // last level have nowhere to go.
+  if (options_->compaction_style == kCompactionStyleLevel &&
+      (options_->deletion_compaction_ratio > 0 ||
+       options_->max_file_age > 0)) {
+    const uint64_t now = options_->env->NowMicros() / 1000000;
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        if (NeedsMarkedCompaction(options_, f, now)) {
+          v->marked_file_ = f;
+          v->marked_file_level_ = level;
+          return;
+        }
+      }
+    }
+  }
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1136,12 +1444,12 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
   std::string record;
-  edit.EncodeTo(&record);
+  edit.EncodeTo(&record, FileFieldsInUse(options_));
   return log->AddRecord(record);
 }
 
@@ -1212,6 +1520,25 @@ int64_t VersionSet::NumLevelBytes(int level) const {
   return TotalFileSize(current_->files_[level]);
 }
 
+uint64_t VersionSet::PendingCompactionBytes() const {
+  uint64_t result = 0;
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    // Files are dropped rather than rewritten.
+    return result;
+  }
+  if (current_->files_[0].size() >= config::kL0_CompactionTrigger) {
+    result += TotalFileSize(current_->files_[0]);
+  }
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    const double excess = TotalFileSize(current_->files_[level]) -
+                          current_->max_bytes_for_level_[level];
+    if (excess > 0) {
+      result += static_cast<uint64_t>(excess);
+    }
+  }
+  return result;
+}
+
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
@@ -1280,8 +1607,9 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewIterator(
+              options, files[i]->number, files[i]->file_size, nullptr,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
@@ -1298,22 +1626,47 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
+  if (options_->compaction_style == kCompactionStyleUniversal) {
+    return PickUniversalCompaction();
+  } else if (options_->compaction_style == kCompactionStyleFIFO) {
+    return PickFIFOCompaction();
+  }
+
   Compaction* c;
   int level;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
+  // the compactions triggered by seeks, and those over compactions of
+  // files full of deletion markers or old data.
   const bool size_compaction = (current_->compaction_score_ >= 1);
   const bool seek_compaction = (current_->file_to_compact_ != nullptr);
+  const bool marked_compaction = (current_->marked_file_ != nullptr);
   if (size_compaction) {
     level = current_->compaction_level_;
     assert(level >= 0);
     assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
+    if (level == 0) {
+      c = PickIntraL0Compaction();
+      if (c != nullptr) {
+        return c;
+      }
+    }
+    c = new Compaction(options_, level, OutputLevel(level),
+                       kCompactionReasonSize);
 
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
+    // Pick the first file that comes after compact_pointer_[level].
+    // Level-0 is kept newest first, so order its files by smallest key
+    // here to walk them in the same order as the other levels.
+    std::vector<FileMetaData*> files = current_->files_[level];
+    if (level == 0) {
+      std::sort(files.begin(), files.end(),
+                [this](FileMetaData* a, FileMetaData* b) {
+                  int r = icmp_.Compare(a->smallest, b->smallest);
+                  return r != 0 ? r < 0 : a->number < b->number;
+                });
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[i];
       if (compact_pointer_[level].empty() ||
           icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
         c->inputs_[0].push_back(f);
@@ -1322,12 +1675,18 @@ Compaction* VersionSet::PickCompaction() {
     }
     if (c->inputs_[0].empty()) {
       // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+      c->inputs_[0].push_back(files[0]);
     }
   } else if (seek_compaction) {
     level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
+    c = new Compaction(options_, level, OutputLevel(level),
+                       kCompactionReasonSeek);
     c->inputs_[0].push_back(current_->file_to_compact_);
+  } else if (marked_compaction) {
+    level = current_->marked_file_level_;
+    c = new Compaction(options_, level, OutputLevel(level),
+                       kCompactionReasonMarked);
+    c->inputs_[0].push_back(current_->marked_file_);
   } else {
     return nullptr;
   }
@@ -1346,11 +1705,208 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
+  if (size_compaction) {
+    AddTrivialMoveInputs(c);
+  }
   SetupOtherInputs(c);
 
   return c;
 }
 
+Compaction* VersionSet::PickIntraL0Compaction() {
+  const std::vector<FileMetaData*>& files = current_->files_[0];
+  if (files.size() < config::kL0_SlowdownWritesTrigger) {
+    return nullptr;
+  }
+
+  // Only worthwhile if moving level-0 down would rewrite much more data
+  // in the next level than level-0 holds, which would keep level-0
+  // crowded for a long time.
+  InternalKey smallest, largest;
+  GetRange(files, &smallest, &largest);
+  std::vector<FileMetaData*> overlapping;
+  current_->GetOverlappingInputs(OutputLevel(0), &smallest, &largest,
+                                 &overlapping);
+  if (TotalFileSize(overlapping) <
+      TotalFileSize(files) * options_->max_bytes_for_level_multiplier) {
+    return nullptr;
+  }
+
+  // Files are kept newest first, so any prefix covers a contiguous range
+  // of sequence numbers and can be replaced by a single file.  Leave out
+  // the large files earlier merges produced.
+  const uint64_t limit = ExpandedCompactionByteSizeLimit(options_);
+  size_t end = 0;
+  uint64_t total_bytes = 0;
+  while (end < files.size() && total_bytes + files[end]->file_size <= limit) {
+    total_bytes += files[end]->file_size;
+    end++;
+  }
+  if (end < config::kL0_CompactionTrigger) {
+    return nullptr;
+  }
+
+  Compaction* c = new Compaction(options_, 0, 0, kCompactionReasonIntraL0);
+  c->max_output_file_size_ = std::numeric_limits<uint64_t>::max();
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].assign(files.begin(), files.begin() + end);
+  return c;
+}
+
+void VersionSet::AddTrivialMoveInputs(Compaction* c) {
+  const int level = c->level();
+  const int output_level = c->output_level();
+  if (c->inputs_[0].size() != 1 || level == output_level) {
+    return;
+  }
+
+  // Level-0 files can only move together if they do not overlap each
+  // other, and must not leave older overlapping data behind.
+  std::vector<FileMetaData*> candidates;
+  if (level == 0) {
+    const Comparator* user_cmp = icmp_.user_comparator();
+    const std::vector<FileMetaData*>& files = current_->files_[0];
+    for (FileMetaData* f : files) {
+      bool overlaps = false;
+      for (FileMetaData* g : files) {
+        if (g != f &&
+            user_cmp->Compare(f->smallest.user_key(), g->largest.user_key()) <=
+                0 &&
+            user_cmp->Compare(g->smallest.user_key(), f->largest.user_key()) <=
+                0) {
+          overlaps = true;
+          break;
+        }
+      }
+      if (!overlaps) {
+        candidates.push_back(f);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [this](FileMetaData* a, FileMetaData* b) {
+                return icmp_.Compare(a->smallest, b->smallest) < 0;
+              });
+  } else {
+    candidates = current_->files_[level];
+  }
+
+  // A file that overlaps lots of grandparent data cannot be moved (see
+  // Compaction::IsTrivialMove()).  Leave the seed alone if it is one, so
+  // that a failed move only rewrites the seed.
+  auto overlaps_grandparents = [this, output_level](FileMetaData* f) {
+    if (output_level + 1 >= config::kNumLevels) {
+      return false;
+    }
+    std::vector<FileMetaData*> overlapping;
+    current_->GetOverlappingInputs(output_level + 1, &f->smallest,
+                                   &f->largest, &overlapping);
+    return TotalFileSize(overlapping) > MaxGrandParentOverlapBytes(options_);
+  };
+
+  auto it = std::find(candidates.begin(), candidates.end(), c->inputs_[0][0]);
+  if (it == candidates.end() || overlaps_grandparents(*it)) {
+    return;
+  }
+  const InternalKey smallest = (*it)->smallest;
+  for (++it; it != candidates.end(); ++it) {
+    FileMetaData* f = *it;
+    std::vector<FileMetaData*> overlapping;
+    current_->GetOverlappingInputs(output_level, &smallest, &f->largest,
+                                   &overlapping);
+    if (!overlapping.empty() || overlaps_grandparents(f)) {
+      break;
+    }
+    c->inputs_[0].push_back(f);
+  }
+}
+
+Compaction* VersionSet::PickUniversalCompaction() {
+  // Every level-0 file is a sorted run, kept newest first.
+  const std::vector<FileMetaData*>& runs = current_->files_[0];
+  if (runs.size() < config::kL0_CompactionTrigger) {
+    return nullptr;
+  }
+  const size_t num_runs = runs.size();
+
+  size_t start = 0;
+  size_t end = 0;
+
+  // Merge everything if the newer runs take up too much space compared
+  // to the oldest one, which holds most of the data.
+  uint64_t newer_bytes = 0;
+  for (size_t i = 0; i + 1 < num_runs; i++) {
+    newer_bytes += runs[i]->file_size;
+  }
+  if (newer_bytes * 100 >=
+      runs[num_runs - 1]->file_size *
+          static_cast<uint64_t>(
+              options_->universal_max_size_amplification_percent)) {
+    end = num_runs;
+  }
+
+  // Otherwise merge the newest sequence of runs of similar size: each run
+  // joins if it is not much larger than the runs before it combined.
+  const size_t min_width = std::max(options_->universal_min_merge_width, 2);
+  const size_t max_width = options_->universal_max_merge_width > 0
+                               ? options_->universal_max_merge_width
+                               : num_runs;
+  for (size_t i = 0; end == 0 && i + min_width <= num_runs; i++) {
+    uint64_t candidate_bytes = runs[i]->file_size;
+    size_t j = i + 1;
+    while (j < num_runs && j - i < max_width &&
+           runs[j]->file_size * 100 <=
+               candidate_bytes * (100 + options_->universal_size_ratio)) {
+      candidate_bytes += runs[j]->file_size;
+      j++;
+    }
+    if (j - i >= min_width) {
+      start = i;
+      end = j;
+    }
+  }
+
+  // Otherwise bring the number of runs back under the trigger by merging
+  // the newest ones.
+  if (end == 0) {
+    end = num_runs - config::kL0_CompactionTrigger + 2;
+  }
+
+  Compaction* c = new Compaction(options_, 0, 0, kCompactionReasonUniversal);
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].assign(runs.begin() + start, runs.begin() + end);
+  return c;
+}
+
+Compaction* VersionSet::PickFIFOCompaction() {
+  // Level-0 files are kept newest first, so drop files from the back
+  // until the rest are young enough and fit in the size limit.
+  const std::vector<FileMetaData*>& files = current_->files_[0];
+  uint64_t total_bytes = TotalFileSize(files);
+  const uint64_t now = options_->env->NowMicros() / 1000000;
+  size_t keep = files.size();
+  while (keep > 0) {
+    const FileMetaData* f = files[keep - 1];
+    if (!IsExpired(options_, f, now) &&
+        total_bytes <= options_->fifo_max_table_files_size) {
+      break;
+    }
+    total_bytes -= f->file_size;
+    keep--;
+  }
+  if (keep == files.size()) {
+    return nullptr;
+  }
+
+  Compaction* c = new Compaction(options_, 0, 0, kCompactionReasonFIFO);
+  c->deletion_compaction_ = true;
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  c->inputs_[0].assign(files.begin() + keep, files.end());
+  return c;
+}
+
 // Finds the largest key in a vector of files. Returns true if files it not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1432,12 +1988,13 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
+  const int output_level = c->output_level();
   InternalKey smallest, largest;
 
   AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
   GetRange(c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level + 1, &smallest, &largest,
+  current_->GetOverlappingInputs(output_level, &smallest, &largest,
                                  &c->inputs_[1]);
 
   // Get entire range covered by compaction
@@ -1445,7 +2002,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
-  // changing the number of "level+1" files we pick up.
+  // changing the number of "output_level" files we pick up.
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
@@ -1459,7 +2016,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+      current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                      &expanded1);
       if (expanded1.size() == c->inputs_[1].size()) {
         Log(options_->info_log,
@@ -1477,9 +2034,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   }
 
   // Compute the set of grandparent files that overlap this compaction
-  // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+  // (parent == output_level; grandparent == output_level+1)
+  if (output_level + 1 < config::kNumLevels) {
+    current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                    &c->grandparents_);
   }
 
@@ -1493,6 +2050,22 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
                                      const InternalKey* end) {
+  if (options_->compaction_style == kCompactionStyleFIFO) {
+    // Files are never merged; they only expire.
+    return nullptr;
+  } else if (options_->compaction_style == kCompactionStyleUniversal) {
+    // Sorted runs are only ever merged with the runs next to them in age,
+    // so merge them all regardless of the range.
+    if (level != 0 || current_->files_[0].size() < 2) {
+      return nullptr;
+    }
+    Compaction* c = new Compaction(options_, 0, 0, kCompactionReasonManual);
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    c->inputs_[0] = current_->files_[0];
+    return c;
+  }
+
   std::vector<FileMetaData*> inputs;
   current_->GetOverlappingInputs(level, begin, end, &inputs);
   if (inputs.empty()) {
@@ -1516,7 +2089,8 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
     }
   }
 
-  Compaction* c = new Compaction(options_, level);
+  Compaction* c = new Compaction(options_, level, OutputLevel(level),
+                                 kCompactionReasonManual);
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
@@ -1524,13 +2098,23 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   return c;
 }
 
-Compaction::Compaction(const Options* options, int level)
+Compaction::Compaction(const Options* options, int level, int output_level,
+                       CompactionReason reason)
     : level_(level),
-      max_output_file_size_(MaxFileSizeForLevel(options, level)),
+      output_level_(output_level),
+      reason_(reason),
+      deletion_compaction_(false),
+      max_output_file_size_(MaxFileSizeForLevel(options, output_level)),
+      min_aligned_output_file_size_(0),
       input_version_(nullptr),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
+  if (options->compaction_output_alignment_ratio > 0 &&
+      max_output_file_size_ != std::numeric_limits<uint64_t>::max()) {
+    min_aligned_output_file_size_ = static_cast<uint64_t>(
+        max_output_file_size_ * options->compaction_output_alignment_ratio);
+  }
   for (int i = 0; i < config::kNumLevels; i++) {
     level_ptrs_[i] = 0;
   }
@@ -1544,18 +2128,67 @@ Compaction::~Compaction() {
 
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
-  // Avoid a move if there is lots of overlapping grandparent data.
+  const Comparator* user_cmp = vset->icmp_.user_comparator();
+  if (level_ == output_level_ || num_input_files(1) != 0) {
+    return false;
+  }
+  if (reason_ == kCompactionReasonMarked) {
+    // Marked files are compacted to get rid of their deletion markers or
+    // old data, which moving them would keep.
+    return false;
+  }
+  if (level_ == 0 && num_input_files(0) > 1) {
+    // Overlapping level-0 files have to be merged.
+    std::vector<FileMetaData*> files = inputs_[0];
+    std::sort(files.begin(), files.end(),
+              [vset](FileMetaData* a, FileMetaData* b) {
+                return vset->icmp_.Compare(a->smallest, b->smallest) < 0;
+              });
+    for (size_t i = 1; i < files.size(); i++) {
+      if (user_cmp->Compare(files[i - 1]->largest.user_key(),
+                            files[i]->smallest.user_key()) >= 0) {
+        return false;
+      }
+    }
+  }
+  // Avoid a move if any file overlaps lots of grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
-          TotalFileSize(grandparents_) <=
-              MaxGrandParentOverlapBytes(vset->options_));
+  for (FileMetaData* f : inputs_[0]) {
+    int64_t overlap = 0;
+    for (FileMetaData* g : grandparents_) {
+      if (user_cmp->Compare(f->smallest.user_key(), g->largest.user_key()) <=
+              0 &&
+          user_cmp->Compare(g->smallest.user_key(), f->largest.user_key()) <=
+              0) {
+        overlap += g->file_size;
+      }
+    }
+    if (overlap > MaxGrandParentOverlapBytes(vset->options_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint64_t Compaction::OldestCreationTime() const {
+  uint64_t result = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      const uint64_t t = inputs_[which][i]->creation_time;
+      if (t != 0 && (result == 0 || t < result)) {
+        result = t;
+      }
+    }
+  }
+  return result;
 }
 
 void Compaction::AddInputDeletions(VersionEdit* edit) {
   for (int which = 0; which < 2; which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
-      edit->DeleteFile(level_ + which, inputs_[which][i]->number);
+      edit->DeleteFile(which == 0 ? level_ : output_level_,
+                       inputs_[which][i]->number);
     }
   }
 }
@@ -1563,7 +2196,19 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  if (output_level_ == 0) {
+    // Level-0 files that are not part of this compaction may hold older
+    // data for the key.
+    for (FileMetaData* f : input_version_->files_[0]) {
+      if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          user_cmp->Compare(user_key, f->largest.user_key()) <= 0 &&
+          std::find(inputs_[0].begin(), inputs_[0].end(), f) ==
+              inputs_[0].end()) {
+        return false;
+      }
+    }
+  }
+  for (int lvl = output_level_ + 1; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     for (; level_ptrs_[lvl] < files.size();) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1581,22 +2226,32 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  uint64_t output_bytes) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
+  bool crossed_boundary = false;
   while (grandparent_index_ < grandparents_.size() &&
          icmp->Compare(internal_key,
                        grandparents_[grandparent_index_]->largest.Encode()) >
              0) {
     if (seen_key_) {
       overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+      crossed_boundary = true;
     }
     grandparent_index_++;
   }
   seen_key_ = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (crossed_boundary && min_aligned_output_file_size_ > 0 &&
+      output_bytes >= min_aligned_output_file_size_) {
+    // The current output is large enough and ends before the next
+    // grandparent file, so it will not overlap that file.
+    overlapped_bytes_ = 0;
+    return true;
+  } else if (overlapped_bytes_ >
+             MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
     overlapped_bytes_ = 0;
     return true;
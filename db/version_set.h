@@ -50,6 +50,7 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class PinnableSlice;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -97,12 +98,27 @@ class Version {
   };
 
   // Append to *iters a sequence of iterators that will
-  // yield the contents of this Version when merged together.
+  // yield the contents of this Version when merged together.  Files that
+  // lie entirely outside options.iterate_lower_bound and
+  // options.iterate_upper_bound are left out.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
-  Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+  // Like AddIterators(), but only for the files in levels
+  // [first_level, last_level].
+  void AddIterators(const ReadOptions&, int first_level, int last_level,
+                    std::vector<Iterator*>* iters);
+
+  // Returns true iff this version has the same files as "other" in every
+  // level >= first_level.
+  bool SameFiles(const Version* other, int first_level) const;
+
+  // The value found is pinned in *val: it refers to the block that holds
+  // it for as long as *val is not reset.
+  // Merge operands for key that are newer than the value found (or all of
+  // them, if there is none) are appended to *merge_operands, newest first.
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
+             GetStats* stats, std::vector<std::string>* merge_operands);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -110,8 +126,9 @@ class Version {
   bool UpdateStats(const GetStats& stats);
 
   // Record a sample of bytes read at the specified internal key.
-  // Samples are taken approximately once every config::kReadBytesPeriod
-  // bytes.  Returns true if a new compaction may need to be triggered.
+  // Samples are taken approximately once every
+  // Options::read_sampling_period bytes.  Returns true if a new compaction
+  // may need to be triggered.
   // REQUIRES: lock is held
   bool RecordReadSample(Slice key);
 
@@ -138,6 +155,14 @@ class Version {
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                  const Slice& largest_user_key);
 
+  // Return the level at which we should place a file added by
+  // DB::IngestExternalFile() that covers the range
+  // [smallest_user_key,largest_user_key].  Its entries are newer than
+  // everything in the database, so it goes to the deepest level above
+  // which no file overlaps the range.
+  int PickLevelForExternalFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   int NumFiles(int level) const { return files_[level].size(); }
 
   // Return a human readable string that describes this version's contents.
@@ -156,8 +181,11 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
+        marked_file_(nullptr),
+        marked_file_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        base_level_(1) {}
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -197,6 +225,11 @@ class Version {
   // file_to_compact_的level
   int file_to_compact_level_;
 
+  // File that should be compacted because it is mostly deletion markers or
+  // holds old data, and its level.  Initialized by Finalize().
+  FileMetaData* marked_file_;
+  int marked_file_level_;
+
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
@@ -204,6 +237,11 @@ class Version {
   // 当前最大的compact权重以及对应的level
   double compaction_score_;
   int compaction_level_;
+
+  // Target combined file size for each level, and the level into which
+  // level-0 is compacted.  Initialized by Finalize().
+  double max_bytes_for_level_[config::kNumLevels];
+  int base_level_;
 };
 
 
@@ -259,6 +297,20 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return the level into which a compaction of "level" writes.
+  int OutputLevel(int level) const {
+    if (level > 0) {
+      return level + 1;
+    }
+    return options_->compaction_style == kCompactionStyleLevel
+               ? current_->base_level_
+               : 0;
+  }
+
+  // Return an estimate of the number of bytes that compactions must
+  // rewrite to bring every level back under its size target.
+  uint64_t PendingCompactionBytes() const;
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -284,6 +336,17 @@ class VersionSet {
   // describes the compaction.  Caller should delete the result.
   Compaction* PickCompaction();
 
+  // Pick the sorted runs to merge under kCompactionStyleUniversal.
+  Compaction* PickUniversalCompaction();
+
+  // Pick the oldest files to drop under kCompactionStyleFIFO.
+  Compaction* PickFIFOCompaction();
+
+  // Pick the newest level-0 files to merge into a single level-0 file
+  // when there are many of them and moving them into the next level would
+  // rewrite lots of data.  Returns nullptr if that is not worthwhile.
+  Compaction* PickIntraL0Compaction();
+
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
@@ -302,7 +365,8 @@ class VersionSet {
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           (v->marked_file_ != nullptr);
   }
 
   // Add all files listed in any live version to *live.
@@ -328,6 +392,9 @@ class VersionSet {
 
   bool ReuseManifest(const std::string& dscname, const std::string& dscbase);
 
+  // Compute the target size of each level of "v" and its base level.
+  void ComputeLevelTargets(Version* v);
+
   void Finalize(Version* v);
 
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
@@ -339,6 +406,11 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Add the files that follow the single input of "c" in key order as long
+  // as none of them overlaps the output level, so that the whole run can
+  // be moved by one trivial move.
+  void AddTrivialMoveInputs(Compaction* c);
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -384,6 +456,18 @@ class VersionSet {
   std::string compact_pointer_[config::kNumLevels];
 };
 
+// Why a compaction was picked.
+enum CompactionReason {
+  kCompactionReasonSize,       // A level holds more data than its target
+  kCompactionReasonSeek,       // A file was read through too often
+  kCompactionReasonMarked,     // A file holds many deletions or old data
+  kCompactionReasonIntraL0,    // Level-0 is crowded but costly to move down
+  kCompactionReasonUniversal,  // Picked by kCompactionStyleUniversal
+  kCompactionReasonFIFO,       // Picked by kCompactionStyleFIFO
+  kCompactionReasonManual,     // Requested through DB::CompactRange()
+  kNumCompactionReasons
+};
+
 // A Compaction encapsulates information about a compaction.
 // 封装关于压缩的信息
 class Compaction {
@@ -391,9 +475,19 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // and "output_level" will be merged to produce a set of "output_level"
+  // files.
   int level() const { return level_; }
 
+  // Return the level the compaction writes to.  This is "level+1", except
+  // for level-0 compactions, which write to the base level when level sizes
+  // are computed dynamically and back to level-0 under universal and FIFO
+  // compaction.
+  int output_level() const { return output_level_; }
+
+  // Return why the compaction was picked.
+  CompactionReason reason() const { return reason_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -401,27 +495,36 @@ class Compaction {
   // "which" must be either 0 or 1
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()" if "which" is 0, or at
+  // "output_level()" if "which" is 1.
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
   uint64_t MaxOutputFileSize() const { return max_output_file_size_; }
 
   // Is this a trivial compaction that can be implemented by just
-  // moving a single input file to the next level (no merging or splitting)
+  // moving the input files to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
+  // Does this compaction only drop its input files without writing any
+  // output?  Used by kCompactionStyleFIFO.
+  bool IsDeletionCompaction() const { return deletion_compaction_; }
+
+  // Return the creation time of the oldest input file, or zero if none
+  // of the inputs records one.
+  uint64_t OldestCreationTime() const;
+
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
   bool IsBaseLevelForKey(const Slice& user_key);
 
-  // Returns true iff we should stop building the current output
-  // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  // Returns true iff we should stop building the current output, which
+  // holds "output_bytes" so far, before processing "internal_key".
+  bool ShouldStopBefore(const Slice& internal_key, uint64_t output_bytes);
 
   // Release the input version for the compaction, once the compaction
   // is successful.
@@ -431,18 +534,25 @@ class Compaction {
   friend class Version;
   friend class VersionSet;
 
-  Compaction(const Options* options, int level);
+  Compaction(const Options* options, int level, int output_level,
+             CompactionReason reason);
 
   // 要compact的level
   int level_;
+  int output_level_;
+  CompactionReason reason_;
+  bool deletion_compaction_;
   // 生成sstable文件的最大size(options->max_file_size)
   uint64_t max_output_file_size_;
+  // Outputs at least this large are cut at grandparent file boundaries.
+  // Zero if they are only cut at max_output_file_size_.
+  uint64_t min_aligned_output_file_size_;
   // compact时当前的version
   Version* input_version_;
   // 记录compact过程中的操作
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
+  // Each compaction reads inputs from "level_" and "output_level_"
   /*
     inputs_[0]:为level-n的sstable文件信息
     inputs_[1]:为level-n+1的sstable文件信息
@@ -450,7 +560,7 @@ class Compaction {
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
   // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // (parent == output_level_, grandparent == output_level_ + 1)
   /*
     1.位于leveln+2,并且与compact的key-range有overlap的sstable文件。
     2.保持grandparents_是因为compact最终会生成一系列level-n+1的sstable文件，
@@ -38,6 +38,14 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeMerge:
+        state.append("Merge(");
+        state.append(ikey.user_key.ToString());
+        state.append(", ");
+        state.append(iter->value().ToString());
+        state.append(")");
+        count++;
+        break;
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
@@ -75,6 +83,20 @@ TEST(WriteBatchTest, Multiple) {
       PrintContents(&batch));
 }
 
+TEST(WriteBatchTest, Merge) {
+  WriteBatch batch;
+  batch.Put(Slice("foo"), Slice("bar"));
+  batch.Merge(Slice("foo"), Slice("baz"));
+  batch.Merge(Slice("box"), Slice("boo"));
+  WriteBatchInternal::SetSequence(&batch, 100);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+  ASSERT_EQ(
+      "Merge(box, boo)@102"
+      "Merge(foo, baz)@101"
+      "Put(foo, bar)@100",
+      PrintContents(&batch));
+}
+
 TEST(WriteBatchTest, Corruption) {
   WriteBatch batch;
   batch.Put(Slice("foo"), Slice("bar"));
@@ -287,6 +287,14 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& fname,
+                           const std::string& old_fname,
+                           WritableFile** result) override {
+    // In-memory files cannot be overwritten in place, so fall back to
+    // renaming and truncating the file.
+    return Env::ReuseWritableFile(fname, old_fname, result);
+  }
+
   bool FileExists(const std::string& fname) override {
     MutexLock lock(&mutex_);
     return file_map_.find(fname) != file_map_.end();
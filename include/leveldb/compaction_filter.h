@@ -0,0 +1,58 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A database can be configured with a custom CompactionFilter object.
+// Compactions consult it for every entry that they would otherwise keep,
+// which lets applications expire or rewrite records as part of the work
+// leveldb does anyway instead of scanning the database themselves.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  // Information about the compaction that is calling Filter().
+  struct Context {
+    // The level being compacted, and the level its output is written to.
+    int level;
+    int output_level;
+
+    // True if the compaction was requested through DB::CompactRange().
+    bool is_manual_compaction;
+  };
+
+  enum Decision {
+    kKeep,         // Keep the entry as it is
+    kRemove,       // Delete the entry
+    kChangeValue,  // Replace the value of the entry with *new_value
+  };
+
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter.  Used for logging.
+  virtual const char* Name() const = 0;
+
+  // Decide what to do with the entry "key" -> "existing_value".  Only
+  // the latest value of a key that is visible to every snapshot is
+  // passed in; older values, values only some snapshots can see, and
+  // deletions are not.
+  //
+  // Filter() may be called concurrently from several threads and must
+  // not call back into the database.
+  virtual Decision Filter(const Context& context, const Slice& key,
+                          const Slice& existing_value,
+                          std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
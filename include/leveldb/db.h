@@ -11,6 +11,7 @@
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -72,6 +73,13 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Combine "value" with the current value of "key" using
+  // options.merge_operator, without reading the current value now.
+  // Returns NotSupported if the database has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +95,37 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get() above, but on success *value may refer to the memory that
+  // the DB holds the value in (a block cache entry or a memtable) instead
+  // of a copy.  That memory stays pinned until *value is reset or
+  // destroyed, which must happen before this db is deleted.
+  //
+  // The default implementation copies the value into *value.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
+  // If the database contains an entry for "key" store the size of its
+  // value in *size and return OK.  Like Get() with a PinnableSlice, this
+  // does not copy the value unless it has to be merged.
+  //
+  // If there is no entry for "key" return a status for which
+  // Status::IsNotFound() returns true.
+  virtual Status GetValueSize(const ReadOptions& options, const Slice& key,
+                              uint64_t* size);
+
+  // Return OK if the database contains an entry for "key", and a status
+  // for which Status::IsNotFound() returns true if it does not.
+  virtual Status KeyExists(const ReadOptions& options, const Slice& key);
+
+  // Return false if the database certainly contains no entry for "key".
+  // The answer comes from memory only (the memtables, the filters of open
+  // tables and the block cache), so true only means that the key may
+  // exist.  If the entry was found in memory and value_found is non-null,
+  // *value_found is set to true and, if value is non-null, the value is
+  // stored in *value; otherwise *value_found is set to false.
+  virtual bool KeyMayExist(const ReadOptions& options, const Slice& key,
+                           std::string* value, bool* value_found);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -116,11 +155,23 @@ class LEVELDB_EXPORT DB {
   //  "leveldb.num-files-at-level<N>" - return the number of files at level <N>,
   //     where <N> is an ASCII representation of a level number (e.g. "0").
   //  "leveldb.stats" - returns a multi-line string that describes statistics
-  //     about the internal operation of the DB.
+  //     about the internal operation of the DB: per level compaction work
+  //     and amplification, compactions by reason and write stall times.
+  //     The "Int" row covers the time since the property was last read.
+  //  "leveldb.compaction-stats" - returns the counters behind
+  //     "leveldb.stats" as "name=value" lines.  All counters are cumulative
+  //     since the DB was opened.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.table-properties" - returns the properties recorded in each
+  //     of the sstables (see TableProperties), level by level.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.write-stalls" - returns a multi-line string that describes how
+  //     often and for how long writes were slowed down or stopped, by cause.
+  //  "leveldb.table-bytes-written" - returns the number of bytes written to
+  //     table files by memtable and background compactions since the DB was
+  //     opened.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -145,6 +196,24 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Hand all writes buffered by WriteOptions::manual_wal_flush to the
+  // operating system.  If "sync" is true, also sync the log file to
+  // durable storage, making every write that completed before this call
+  // durable.  Returns OK on success, and a non-OK status on error.
+  virtual Status FlushWAL(bool sync) = 0;
+
+  // Add the file "fname", built by SstFileWriter with options compatible
+  // with this database, to the database.  The entries of the file are
+  // made visible atomically and are newer than every write that
+  // completed before this call.  The file is placed in the deepest level
+  // where it does not overlap existing data, so a bulk load of disjoint
+  // files needs no compaction at all.
+  //
+  // Returns OK on success, and a non-OK status on error.  On error the
+  // database is unchanged.
+  virtual Status IngestExternalFile(const IngestExternalFileOptions& options,
+                                    const std::string& fname) = 0;
 };
 
 // Destroy the contents of the specified database.
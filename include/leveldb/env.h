@@ -114,6 +114,21 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Rename the existing file "old_fname" to "fname" and create an
+  // object that overwrites it starting at offset zero.  Unlike
+  // NewWritableFile, the file is not truncated, so writes over the old
+  // contents do not have to allocate new space in the filesystem.  On
+  // success, stores a pointer to the file in *result and returns OK.
+  // On failure stores nullptr in *result and returns non-OK.
+  //
+  // The returned file will only be accessed by one thread at a time.
+  //
+  // The default implementation renames the file and then truncates it
+  // via NewWritableFile().
+  virtual Status ReuseWritableFile(const std::string& fname,
+                                   const std::string& old_fname,
+                                   WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -258,6 +273,12 @@ class LEVELDB_EXPORT WritableFile {
   virtual Status Close() = 0;
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
+
+  // Hint that the file is expected to grow to "size" bytes.  An
+  // implementation may reserve the space up front, without changing the
+  // file's length, so that later appends and syncs do not have to
+  // allocate space.  The default implementation does nothing.
+  virtual Status Preallocate(uint64_t size);
 };
 
 // An interface for writing log messages.
@@ -326,6 +347,10 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status ReuseWritableFile(const std::string& f, const std::string& old_f,
+                           WritableFile** r) override {
+    return target_->ReuseWritableFile(f, old_f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -72,6 +72,12 @@ class LEVELDB_EXPORT Iterator {
   // If an error has occurred, return it.  Else return an ok status.
   virtual Status status() const = 0;
 
+  // Returns true if the storage for the current key() stays valid, and
+  // unchanged, until this iterator is deleted instead of only until its
+  // next modification.  Callers can then keep the key without copying it.
+  // REQUIRES: Valid()
+  virtual bool IsKeyPinned() const { return false; }
+
   // Clients are allowed to register function/arg1/arg2 triples that
   // will be invoked when this iterator is destroyed.
   //
@@ -0,0 +1,56 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator implements read-modify-write updates such as counters
+// or appends.  DB::Merge() records an operand for a key without reading
+// its current value; reads and compactions later combine the operands
+// with the value they apply to.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the merge operator.  The operands stored in a database
+  // are only meaningful to the operator that wrote them, so the name
+  // should change whenever their interpretation does.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", ordered from oldest to newest, to "existing_value"
+  // for "key" and store the result in *new_value.  "existing_value" is
+  // nullptr if the key had no value before the first operand (it never
+  // existed or was deleted).
+  //
+  // Return false if the operands cannot be applied, in which case the
+  // read or compaction that needed the result fails with a corruption
+  // error.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine two consecutive operands for "key", "left_operand" being the
+  // older one, into a single operand with the same effect and store it in
+  // *new_value.  Compactions use this to shorten operand chains whose
+  // value is not yet known.
+  //
+  // Return false if the operands cannot be combined on their own.  The
+  // default implementation always returns false.
+  virtual bool PartialMerge(const Slice& key, const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,16 +6,21 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class Slice;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -29,6 +34,26 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// How table files are organized and picked for compaction.
+enum CompactionStyle {
+  // Files are organized in levels of exponentially increasing size, each
+  // level holding a single sorted run.  Keeps reads and space overhead
+  // low at the price of rewriting data once per level.
+  kCompactionStyleLevel = 0,
+
+  // All files stay in level-0, each one a sorted run, and runs of similar
+  // size are merged together.  Rewrites data far fewer times than
+  // kCompactionStyleLevel, at the price of more runs to consult on reads
+  // and of up to twice the space during full merges.
+  kCompactionStyleUniversal = 1,
+
+  // All files stay in level-0 and are never rewritten.  The oldest files
+  // are deleted once the files take up too much space or grow too old.
+  // Only suited to data that may be lost after a while, such as caches or
+  // event logs.
+  kCompactionStyleFIFO = 2
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -75,12 +100,40 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.
   // Also, a larger write buffer will result in a longer recovery time
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of write buffers, the active one included, held in
+  // memory at the same time.  Full write buffers wait in memory until a
+  // background thread writes them to a level-0 file; all the ones that
+  // are waiting are written out together into a single file.  Writes
+  // stall only once this many write buffers are in memory, so larger
+  // values absorb longer bursts of writes, at the cost of memory and
+  // longer recovery.
+  //
+  // Default: 2
+  int max_write_buffer_number = 2;
+
+  // Once level-0 holds enough files to slow down writes, or compactions
+  // have fallen more than soft_pending_compaction_bytes_limit behind,
+  // writes are admitted at no more than this many bytes per second.  The
+  // rate is lowered further as the backlog grows, so that write latency
+  // degrades gradually instead of jumping straight to a full stall.
+  //
+  // Default: 16MB/s
+  size_t delayed_write_rate = 16 * 1024 * 1024;
+
+  // Start delaying writes once the amount of data that compactions must
+  // rewrite to bring every level back under its size target exceeds this
+  // many bytes.  Zero disables this trigger.
+  //
+  // Default: 1GB
+  uint64_t soft_pending_compaction_bytes_limit = 1024 * 1024 * 1024;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -110,6 +163,20 @@ struct LEVELDB_EXPORT Options {
   */
   int block_restart_interval = 16;
 
+  // Number of keys between restart points in the index block of a table.
+  // The index block of every open table stays in memory, and larger
+  // values make it smaller at the cost of a short linear search on every
+  // lookup.  This parameter can be changed dynamically.
+  int index_block_restart_interval = 1;
+
+  // If true, the index blocks of new tables store the full location of a
+  // data block only at restart points: other entries only store the size
+  // of the block, since data blocks are laid out back to back.  Together
+  // with a larger index_block_restart_interval this shrinks index blocks
+  // considerably.  Tables written this way cannot be read by versions of
+  // leveldb that predate this option; older tables are always readable.
+  bool delta_encode_index_handles = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -120,6 +187,118 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // Compactions into level L >= 2 write files of up to
+  // max_file_size * max_file_size_multiplier^(L-1) bytes.  Larger files
+  // in the bigger, deeper levels keep the number of files down.
+  //
+  // Default: 1
+  int max_file_size_multiplier = 1;
+
+  // If non-zero, a compaction output file that has reached this fraction
+  // of the file size for its level is closed at the next boundary between
+  // files of the level below it, so that the output files line up with
+  // them.  Compacting such a file later on then pulls in fewer files of
+  // the level below.  Values between 0.5 and 0.9 work well.
+  //
+  // Default: 0 (only cut files at the size limit)
+  double compaction_output_alignment_ratio = 0;
+
+  // Target combined size of the files in level-1.  Each level below it
+  // may hold max_bytes_for_level_multiplier times as much as the level
+  // above before its files are compacted into the next level.
+  //
+  // Default: 10MB
+  uint64_t max_bytes_for_level_base = 10 * 1048576;
+
+  // Ratio between the target sizes of adjacent levels.
+  //
+  // Default: 10
+  int max_bytes_for_level_multiplier = 10;
+
+  // If true, derive the level size targets from the amount of data
+  // actually in the database instead of from max_bytes_for_level_base.
+  // The last level gets a target equal to its current size and every
+  // level above it a target max_bytes_for_level_multiplier times smaller.
+  // The upper levels whose targets would drop below
+  // max_bytes_for_level_base / max_bytes_for_level_multiplier stay empty,
+  // and level-0 is compacted directly into the first level that has a
+  // target (the "base level").  This keeps the size ratio between all
+  // levels at the multiplier regardless of database size, which bounds
+  // space amplification and avoids paying for a partially filled extra
+  // level.
+  //
+  // Default: false
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // Iterators sample the keys they read about once every this many bytes.
+  // A sampled key that is found in more than one file charges the newest
+  // of them a seek, the same as a Get() that has to read several files,
+  // and a file that runs out of seeks is compacted.  Larger values make
+  // iterators cheaper but compact read-heavy key ranges later; zero
+  // disables sampling.
+  //
+  // Default: 1MB
+  size_t read_sampling_period = 1024 * 1024;
+
+  // The compaction strategy.  See CompactionStyle.  A database must
+  // always be opened with the same style.
+  //
+  // Default: kCompactionStyleLevel
+  CompactionStyle compaction_style = kCompactionStyleLevel;
+
+  // kCompactionStyleUniversal: a sorted run joins the runs newer than it in
+  // a merge if it is no more than this many percent larger than their
+  // combined size.
+  //
+  // Default: 1
+  int universal_size_ratio = 1;
+
+  // kCompactionStyleUniversal: minimum and maximum number of sorted runs
+  // merged by a compaction picked by size ratio.  A maximum of zero means
+  // no limit.
+  //
+  // Default: 2 and 0
+  int universal_min_merge_width = 2;
+  int universal_max_merge_width = 0;
+
+  // kCompactionStyleUniversal: merge all sorted runs once the runs other
+  // than the oldest take up more than this many percent of the size of the
+  // oldest one, bounding the space taken by obsolete entries.
+  //
+  // Default: 200
+  int universal_max_size_amplification_percent = 200;
+
+  // kCompactionStyleFIFO: delete the oldest files once all files together
+  // take up more than this many bytes.
+  //
+  // Default: 1GB
+  uint64_t fifo_max_table_files_size = 1024 * 1024 * 1024;
+
+  // kCompactionStyleFIFO: delete files holding data written more than this
+  // many seconds ago.  Files are checked whenever the set of files changes,
+  // e.g. after a memtable is written out.  Zero disables the check.
+  //
+  // Default: 0
+  uint64_t fifo_ttl = 0;
+
+  // kCompactionStyleLevel: compact a file into the next level once at
+  // least this fraction of its entries are deletion markers, even if its
+  // level is under its size target.  This lets tombstones reach the level
+  // where they can be dropped instead of slowing down reads that have to
+  // skip over them.  Zero disables the check.
+  //
+  // Default: 0
+  double deletion_compaction_ratio = 0;
+
+  // kCompactionStyleLevel: compact a file into the next level once the
+  // oldest data in it was written more than this many seconds ago, so that
+  // old data keeps moving towards the last level where obsolete entries
+  // are dropped.  Files are checked whenever the set of files changes.
+  // Zero disables the check.
+  //
+  // Default: 0
+  uint64_t max_file_age = 0;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -136,16 +315,54 @@ struct LEVELDB_EXPORT Options {
   // efficiently detect that and will switch to uncompressed mode.
   CompressionType compression = kSnappyCompression;
 
+  // Compress each write-ahead log record (i.e. each group of batched
+  // writes) using the specified compression algorithm.  Reduces the
+  // number of bytes written to the log by the data's compression ratio
+  // at the cost of some CPU on the write path.  Logs written with this
+  // option cannot be read by older versions of leveldb.
+  //
+  // Default: kNoCompression
+  CompressionType wal_compression = kNoCompression;
+
   // EXPERIMENTAL: If true, append to existing MANIFEST and log files
   // when a database is opened.  This can significantly speed up open.
   //
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If non-zero, keep up to this many obsolete log files around and
+  // reuse them (by renaming them and overwriting their contents) instead
+  // of creating new log files.  Overwriting an existing file avoids the
+  // filesystem metadata updates that make the first syncs of a freshly
+  // created file expensive.  Log records then carry the log number so
+  // that stale data from a file's previous use is never replayed.
+  //
+  // Default: 0
+  int recycle_log_file_num = 0;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If non-null (and filter_policy is non-null), the prefixes this
+  // transform extracts from the keys are added to the filters next to the
+  // keys themselves.  Iterators opened with
+  // ReadOptions::prefix_same_as_start then skip the files and blocks
+  // whose filters rule out the prefix of the Seek() target.  See
+  // slice_transform.h.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-null, compactions pass the entries they keep through this
+  // filter, which may delete them or change their values.  See
+  // compaction_filter.h.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // If non-null, enables DB::Merge() and WriteBatch::Merge(), whose
+  // operands reads and compactions combine using this operator.  A
+  // database holding merge operands must always be opened with an
+  // operator that understands them.  See merge_operator.h.
+  const MergeOperator* merge_operator = nullptr;
 };
 
 // Options that control read operations
@@ -160,11 +377,55 @@ struct LEVELDB_EXPORT ReadOptions {
   // Callers may wish to set this field to false for bulk scans.
   bool fill_cache = true;
 
+  // If true, an iterator that reads many consecutive data blocks of a
+  // table is treated as a long scan: from then on it reads the table in
+  // larger chunks ahead of the blocks it needs, and it no longer adds the
+  // data blocks it reads to the block cache, whatever fill_cache says.
+  // Short range reads keep using the cache as fill_cache says, so scans
+  // do not evict the blocks of point lookups.
+  bool adaptive_readahead = true;
+
+  // If true, reads are answered only from memory: the memtables, tables
+  // that are already open and blocks that are in the block cache.  A read
+  // that would have to read a table file stops with a status for which
+  // Status::IsIncomplete() returns true.
+  bool no_io = false;
+
   // If "snapshot" is non-null, read as of the supplied snapshot
   // (which must belong to the DB that is being read and which must
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true (and Options::prefix_extractor is non-null), an iterator
+  // positioned by Seek() only returns the keys that have the same prefix
+  // as the target: it becomes invalid at the first key with another
+  // prefix.  Files and blocks whose filters rule out the prefix are not
+  // read.  Such iterators may only move forward: Prev() and SeekToLast()
+  // are not supported.
+  bool prefix_same_as_start = false;
+
+  // If non-null, iterators only return keys at or after this bound:
+  // Seek() to a smaller key and SeekToFirst() position the iterator at the
+  // bound, and Prev() stops there.  Files that lie entirely before the
+  // bound are not read.  The bound is copied when the iterator is created.
+  const Slice* iterate_lower_bound = nullptr;
+
+  // If non-null, iterators only return keys before this (exclusive)
+  // bound: Next() stops at the first key at or after it without reading
+  // on through later deleted or hidden entries, SeekToLast() positions the
+  // iterator at the last key before it, and files that lie entirely after
+  // it are not read.  The bound is copied when the iterator is created.
+  const Slice* iterate_upper_bound = nullptr;
+
+  // If true, iterators are not bound to a snapshot of the database.
+  // Whenever such an iterator is positioned with Seek() or SeekToFirst(),
+  // or runs off the end in Next(), it picks up the writes made since its
+  // last refresh.  A refresh re-reads only the memtables and level-0
+  // files, unless a compaction changed the files of the other levels, so
+  // tailing a stream of new keys does not need new iterators.  "snapshot"
+  // is ignored, and Prev() and SeekToLast() are not supported.
+  bool tailing = false;
 };
 
 // Options that control write operations
@@ -186,6 +447,26 @@ struct LEVELDB_EXPORT WriteOptions {
   // with sync==true has similar crash semantics to a "write()"
   // system call followed by "fsync()".
   bool sync = false;
+
+  // If true (and sync is false), the write is only appended to the
+  // in-process buffer of the log file; it is not handed to the
+  // operating system until a later write without this flag, a call to
+  // DB::FlushWAL(), or a switch to a new log file.  Such writes avoid
+  // the write() system call altogether, but may be lost if the process
+  // crashes before the buffer is flushed.  Callers that want group
+  // durability can issue many of these writes and call FlushWAL(true)
+  // periodically.
+  bool manual_wal_flush = false;
+};
+
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  IngestExternalFileOptions() = default;
+
+  // If true, the file is renamed into the database directory instead of
+  // being copied.  The file must then be on the same file system as the
+  // database, and is no longer available under its original name.
+  bool move_files = false;
 };
 
 }  // namespace leveldb
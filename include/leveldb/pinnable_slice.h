@@ -0,0 +1,96 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A PinnableSlice is a Slice that can keep the memory it refers to alive.
+// DB::Get() uses it to return a value that lives in the block cache or in
+// a memtable without copying it: the slice then holds on to ("pins") the
+// cache entry or memtable until it is reset or destroyed.  Values that
+// cannot be pinned are copied into a buffer of the slice.
+//
+// A pinned slice must be reset or destroyed before the DB it was filled
+// in by is deleted.  Like Slice, a PinnableSlice needs external
+// synchronization when a thread may call a non-const method.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice {
+ public:
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+
+  // Copies are kept in a buffer of the slice itself.
+  PinnableSlice() : buf_(&self_space_), cleanup_(nullptr) {}
+
+  // Copies are kept in "*buf", which must outlive the slice.
+  explicit PinnableSlice(std::string* buf) : buf_(buf), cleanup_(nullptr) {}
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  ~PinnableSlice() { Reset(); }
+
+  // Refer to "s", whose storage stays valid until (*function)(arg1, arg2)
+  // is called.  The call is made when the slice is reset or destroyed.
+  void PinSlice(const Slice& s, CleanupFunction function, void* arg1,
+                void* arg2) {
+    Unpin();
+    Slice::operator=(s);
+    cleanup_ = function;
+    arg1_ = arg1;
+    arg2_ = arg2;
+  }
+
+  // Refer to a copy of "s" kept in the buffer.
+  void PinSelf(const Slice& s) {
+    buf_->assign(s.data(), s.size());  // "s" may refer to the pinned memory
+    Unpin();
+    Slice::operator=(*buf_);
+  }
+
+  // Refer to the contents of the buffer, which the caller filled in
+  // through GetSelf().
+  void PinSelf() {
+    Unpin();
+    Slice::operator=(*buf_);
+  }
+
+  // The buffer that copies are kept in.
+  std::string* GetSelf() { return buf_; }
+
+  // Release the memory the slice refers to, if it is pinned, and make the
+  // slice empty.
+  void Reset() {
+    Unpin();
+    clear();
+  }
+
+  // Does the slice refer to memory that it holds pinned, rather than to
+  // its buffer?
+  bool IsPinned() const { return cleanup_ != nullptr; }
+
+ private:
+  void Unpin() {
+    if (cleanup_ != nullptr) {
+      (*cleanup_)(arg1_, arg2_);
+      cleanup_ = nullptr;
+    }
+  }
+
+  std::string self_space_;
+  std::string* const buf_;
+  CleanupFunction cleanup_;
+  void* arg1_;
+  void* arg2_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
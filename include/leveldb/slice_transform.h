@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to its prefix.  A database configured with
+// a prefix extractor (Options::prefix_extractor) and a filter policy also
+// adds the prefixes of its keys to the table filters, which lets
+// iterators opened with ReadOptions::prefix_same_as_start skip the files
+// and blocks that hold no key with the prefix of the Seek() target.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // The name of the transform.  It is stored in every table whose
+  // filters hold prefixes, and those prefixes are only used when a
+  // table is read with a transform of the same name.  The name must
+  // therefore change whenever the transform returns different results.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must be a prefix of "key"
+  // (i.e., point into the same bytes), and all keys with the same prefix
+  // must be adjacent in the comparator order.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Does "key" have a prefix?  Keys outside the domain are not added to
+  // the filters as prefixes, and a prefix seek to such a key is a plain
+  // seek.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of
+// the key.  Keys shorter than that have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,69 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of a database that can later
+// be added to one with DB::IngestExternalFile().  This is much cheaper
+// than loading the same data through DB::Write(): the data is written
+// once, without going through the log, the memtable and compactions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // Create a writer for files that will be added to a database opened
+  // with "options".  The comparator, filter policy, prefix extractor,
+  // block and compression settings of "options" are used for the file.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Deletes the file being built if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Start building a new file named "fname".
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value", or one that deletes "key".
+  // Keys must be added in strictly increasing order according to the
+  // comparator.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  Status Put(const Slice& key, const Slice& value);
+  Status Delete(const Slice& key);
+
+  // Finish building the file and close it.  A file without entries
+  // cannot be ingested.
+  Status Finish();
+
+  // Number of entries added so far.
+  uint64_t NumEntries() const;
+
+  // Size of the file generated so far.  If invoked after a successful
+  // Finish() call, returns the size of the final file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -19,6 +19,7 @@ struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
+struct TableProperties;
 
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
@@ -58,23 +59,57 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns the properties recorded in the table, or nullptr for tables
+  // that have none (such as tables built by older versions of leveldb).
+  // The result stays valid for the lifetime of the table.
+  const TableProperties* GetProperties() const;
+
  private:
   friend class TableCache;
   struct Rep;
+  struct ScanState;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
+  // Callbacks of the iterators returned by NewIterator(), whose "arg" is a
+  // ScanState that tracks the data blocks the iterator reads (see
+  // ReadOptions::adaptive_readahead).
+  static Iterator* ScanBlockReader(void*, const ReadOptions&, const Slice&);
+  static bool ScanPrefixMayMatch(void* arg, const Slice& index_value,
+                                 const Slice& target);
+  static void DeleteScanState(void* arg, void* ignored);
+
+  static Iterator* ReadDataBlock(Table* table, ScanState* scan,
+                                 const ReadOptions& options,
+                                 const Slice& index_value);
+
+  // Used by iterators in ReadOptions::prefix_same_as_start mode.  Returns
+  // false only if the filter of the block with the given index entry
+  // rules out the prefix of "target".
+  bool BlockPrefixMayMatch(const Slice& index_value,
+                           const Slice& target) const;
+
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
   // that key is not present.
+  //
+  // If "block_iter" is non-null, the iterator over the block that holds
+  // the entry is stored in *block_iter (nullptr if no call was made)
+  // instead of being deleted.  The slices passed to handle_result stay
+  // valid until the caller deletes it.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
+                                           const Slice& v),
+                     Iterator** block_iter = nullptr);
+
+  // Returns false only if no key at or after "target" has its prefix.
+  bool PrefixMayMatch(const Slice& target) const;
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadProperties(const Slice& properties_handle_value);
 
   Rep* const rep_;
 };
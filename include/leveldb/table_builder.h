@@ -51,6 +51,16 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // The tables of a database hold internal keys, which tell deletions and
+  // sequence numbers apart.  The database reports how many deletions it
+  // added and the range of the sequence numbers of the entries with this
+  // call.  Finish() then stores them with the properties of the table
+  // (see TableProperties).
+  // REQUIRES: Finish(), Abandon() have not been called
+  void SetInternalKeyProperties(uint64_t num_deletions,
+                                uint64_t smallest_seqno,
+                                uint64_t largest_seqno);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -82,6 +92,7 @@ class LEVELDB_EXPORT TableBuilder {
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void AddIndexEntry();
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
 
   struct Rep;
@@ -0,0 +1,45 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// TableProperties describe the contents of a table file.  TableBuilder
+// stores them in a meta block of the table, so they can be read without
+// going through the data: see Table::GetProperties().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT TableProperties {
+  uint64_t num_entries = 0;
+  uint64_t raw_key_size = 0;    // Total size of the keys
+  uint64_t raw_value_size = 0;  // Total size of the values
+
+  uint64_t num_data_blocks = 0;
+  uint64_t num_compressed_blocks = 0;  // Data blocks stored compressed
+  uint64_t raw_data_size = 0;          // Size of the data blocks
+  uint64_t data_size = 0;  // Size of the data blocks as stored in the file
+  uint64_t index_size = 0;   // Size of the index block when loaded
+  uint64_t filter_size = 0;  // Size of the filter block
+
+  // Recorded for the tables of a database, whose entries are versions of
+  // user keys: the number of deletion markers among the entries and the
+  // range of their sequence numbers.  Zero in other tables.
+  uint64_t num_deletions = 0;
+  uint64_t smallest_seqno = 0;
+  uint64_t largest_seqno = 0;
+
+  // Return a human-readable description, one property per line.
+  std::string ToString() const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
@@ -37,6 +37,9 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // Called for every merge operand.  The default implementation
+    // ignores them.
+    virtual void Merge(const Slice& key, const Slice& value);
   };
 
   WriteBatch();
@@ -53,6 +56,10 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Combine "value" with the current value of "key" using the database's
+  // MergeOperator.  See merge_operator.h.
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
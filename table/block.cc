@@ -87,6 +87,12 @@ class Block::Iter : public Iterator {
   Slice value_;
   Status status_;
 
+  // Set for index blocks with delta-encoded handles.  value_ is then the
+  // stored encoding and handle_value_ the full handle it stands for.
+  const bool delta_encoded_handles_;
+  BlockHandle handle_;
+  std::string handle_value_;
+
   inline int Compare(const Slice& a, const Slice& b) const {
     return comparator_->Compare(a, b);
   }
@@ -113,13 +119,14 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, bool delta_encoded_handles)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
         current_(restarts_),
-        restart_index_(num_restarts_) {
+        restart_index_(num_restarts_),
+        delta_encoded_handles_(delta_encoded_handles) {
     assert(num_restarts_ > 0);
   }
 
@@ -131,7 +138,7 @@ class Block::Iter : public Iterator {
   }
   Slice value() const override {
     assert(Valid());
-    return value_;
+    return delta_encoded_handles_ ? Slice(handle_value_) : value_;
   }
 
   void Next() override {
@@ -219,6 +226,36 @@ class Block::Iter : public Iterator {
     status_ = Status::Corruption("bad entry in block");
     key_.clear();
     value_.clear();
+    handle_value_.clear();
+  }
+
+  // Is the entry at current_ the first one of a restart block?
+  bool AtRestartPoint() {
+    return GetRestartPoint(restart_index_) == current_ ||
+           (restart_index_ + 1 < num_restarts_ &&
+            GetRestartPoint(restart_index_ + 1) == current_);
+  }
+
+  // Decode the handle that value_ stands for into handle_value_.  Entries
+  // past a restart point only store the size of their block, which starts
+  // right after the block of the entry before them.
+  bool DecodeHandle() {
+    Slice input = value_;
+    if (AtRestartPoint()) {
+      if (!handle_.DecodeFrom(&input).ok()) {
+        return false;
+      }
+    } else {
+      uint64_t size;
+      if (!GetVarint64(&input, &size)) {
+        return false;
+      }
+      handle_.set_offset(handle_.offset() + handle_.size() + kBlockTrailerSize);
+      handle_.set_size(size);
+    }
+    handle_value_.clear();
+    handle_.EncodeTo(&handle_value_);
+    return true;
   }
 
   bool ParseNextKey() {
@@ -246,12 +283,17 @@ class Block::Iter : public Iterator {
              GetRestartPoint(restart_index_ + 1) < current_) {
         ++restart_index_;
       }
+      if (delta_encoded_handles_ && !DecodeHandle()) {
+        CorruptionError();
+        return false;
+      }
       return true;
     }
   }
 };
 
-Iterator* Block::NewIterator(const Comparator* comparator) {
+Iterator* Block::NewIterator(const Comparator* comparator,
+                             bool delta_encoded_handles) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
@@ -259,7 +301,8 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts,
+                    delta_encoded_handles);
   }
 }
 
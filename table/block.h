@@ -26,7 +26,13 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
-  Iterator* NewIterator(const Comparator* comparator);
+
+  // If "delta_encoded_handles" is true, the block is an index block whose
+  // entries store a full BlockHandle only at restart points, and just the
+  // size of the block elsewhere (see TableBuilder).  The iterator then
+  // returns full encoded BlockHandles as values.
+  Iterator* NewIterator(const Comparator* comparator,
+                        bool delta_encoded_handles = false);
 
  private:
   class Iter;
@@ -69,6 +69,10 @@ Slice BlockBuilder::Finish() {
   return Slice(buffer_);
 }
 
+bool BlockBuilder::AtRestartPoint() const {
+  return buffer_.empty() || counter_ >= options_->block_restart_interval;
+}
+
 void BlockBuilder::Add(const Slice& key, const Slice& value) {
   Slice last_key_piece(last_key_);
   assert(!finished_);
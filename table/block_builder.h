@@ -41,6 +41,9 @@ class BlockBuilder {
   // Return true iff no entries have been added since the last Reset()
   bool empty() const { return buffer_.empty(); }
 
+  // Return true iff the next entry added starts a restart point.
+  bool AtRestartPoint() const;
+
  private:
   const Options* options_;
   std::string buffer_;              // Destination buffer
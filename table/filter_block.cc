@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -15,8 +16,9 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       const SliceTransform* prefix_extractor)
+    : policy_(policy), prefix_extractor_(prefix_extractor) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
   uint64_t filter_index = (block_offset / kFilterBase);
@@ -30,6 +32,18 @@ void FilterBlockBuilder::AddKey(const Slice& key) {
   Slice k = key;
   start_.push_back(keys_.size());
   keys_.append(k.data(), k.size());
+
+  if (prefix_extractor_ != nullptr && prefix_extractor_->InDomain(k)) {
+    // Keys arrive in order, so a prefix shared by several keys of this
+    // filter only needs to be added once.
+    Slice prefix = prefix_extractor_->Transform(k);
+    if (prefix_start_.empty() ||
+        prefix != Slice(prefixes_.data() + prefix_start_.back(),
+                        prefixes_.size() - prefix_start_.back())) {
+      prefix_start_.push_back(prefixes_.size());
+      prefixes_.append(prefix.data(), prefix.size());
+    }
+  }
 }
 
 Slice FilterBlockBuilder::Finish() {
@@ -49,6 +63,14 @@ Slice FilterBlockBuilder::Finish() {
 }
 
 void FilterBlockBuilder::GenerateFilter() {
+  // Prefixes are summarized by the same filter as the keys.
+  for (size_t i = 0; i < prefix_start_.size(); i++) {
+    start_.push_back(keys_.size() + prefix_start_[i]);
+  }
+  keys_.append(prefixes_);
+  prefixes_.clear();
+  prefix_start_.clear();
+
   const size_t num_keys = start_.size();
   if (num_keys == 0) {
     // Fast path if there are no keys for this filter
@@ -21,16 +21,21 @@
 namespace leveldb {
 
 class FilterPolicy;
+class SliceTransform;
 
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
 // a special block in the Table.
 //
+// If a prefix extractor is supplied, each filter also summarizes the
+// prefixes of its keys, so that it can be probed with a prefix.
+//
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  explicit FilterBlockBuilder(const FilterPolicy*,
+                              const SliceTransform* prefix_extractor = nullptr);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -43,8 +48,11 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const SliceTransform* prefix_extractor_;
   std::string keys_;             // Flattened key contents
   std::vector<size_t> start_;    // Starting index in keys_ of each key
+  std::string prefixes_;         // Flattened prefixes of the keys
+  std::vector<size_t> prefix_start_;  // Starting index in prefixes_
   std::string result_;           // Filter data computed so far
   std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
   std::vector<uint32_t> filter_offsets_;
@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -119,6 +120,29 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, Prefixes) {
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(2);
+  FilterBlockBuilder builder(&policy_, prefix_extractor);
+  builder.StartBlock(0);
+  builder.AddKey("b");  // Outside the domain: no prefix
+  builder.AddKey("foo");
+  builder.AddKey("fox");
+  builder.StartBlock(3100);
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+  // Two filters holding 4 and 2 hashes, since "fo" is only added once
+  ASSERT_EQ(6 * 4 + 2 * 4 + 5, block.size());
+  FilterBlockReader reader(&policy_, block);
+
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "fo"));
+  ASSERT_TRUE(reader.KeyMayMatch(0, "b"));
+  ASSERT_TRUE(!reader.KeyMayMatch(0, "he"));
+  ASSERT_TRUE(reader.KeyMayMatch(3100, "he"));
+  ASSERT_TRUE(!reader.KeyMayMatch(3100, "fo"));
+  delete prefix_extractor;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
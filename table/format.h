@@ -16,8 +16,11 @@
 namespace leveldb {
 
 class Block;
+class BlockBuilder;
+class Iterator;
 class RandomAccessFile;
 struct ReadOptions;
+struct TableProperties;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
 // block or a meta block.
@@ -63,12 +66,19 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the index block stores delta-encoded block handles (see
+  // Options::delta_encode_index_handles).  Such tables have a magic number
+  // of their own so that readers that cannot decode them reject them.
+  bool delta_encoded_index() const { return delta_encoded_index_; }
+  void set_delta_encoded_index(bool v) { delta_encoded_index_ = v; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool delta_encoded_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -76,6 +86,9 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables whose index block is delta-encoded.
+static const uint64_t kDeltaIndexTableMagicNumber = 0xdb4775248b80fb58ull;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -90,6 +103,18 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Name of the metaindex entry that points at the properties block.
+static const char kPropertiesBlockName[] = "leveldb.properties";
+
+// Add the entries of a properties block that holds "props" to "block",
+// which must be empty and order its keys bytewise.
+void AddTableProperties(const TableProperties& props, BlockBuilder* block);
+
+// Fill in *props from the entries of a properties block, which "iter"
+// iterates over.  Entries it does not know about are ignored, and so are
+// entries whose value is bad.
+void ReadTableProperties(Iterator* iter, TableProperties* props);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
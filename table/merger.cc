@@ -4,6 +4,8 @@
 
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -11,6 +13,10 @@
 namespace leveldb {
 
 namespace {
+// Merges the children through a binary heap of the valid children, whose
+// top is the child with the smallest key when moving forward and the one
+// with the largest key when moving backward, so that advancing costs
+// O(log n) comparisons instead of O(n).
 class MergingIterator : public Iterator {
  public:
   MergingIterator(const Comparator* comparator, Iterator** children, int n)
@@ -22,6 +28,7 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
+    heap_.reserve(n);
   }
 
   ~MergingIterator() override { delete[] children_; }
@@ -32,24 +39,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    BuildHeap();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    BuildHeap();
   }
 
   void Next() override {
@@ -72,10 +79,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kForward;
+      current_->Next();
+      BuildHeap();
+    } else {
+      current_->Next();
+      UpdateTop();
     }
-
-    current_->Next();
-    FindSmallest();
   }
 
   void Prev() override {
@@ -101,10 +110,12 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      BuildHeap();
+    } else {
+      current_->Prev();
+      UpdateTop();
     }
-
-    current_->Prev();
-    FindLargest();
   }
 
   Slice key() const override {
@@ -128,51 +139,89 @@ class MergingIterator : public Iterator {
     return status;
   }
 
+  bool IsKeyPinned() const override {
+    assert(Valid());
+    return current_->iter()->IsKeyPinned();
+  }
+
  private:
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Returns true if "a" must be yielded before "b" in the current
+  // direction.  Equal keys are yielded in the order of the children.
+  bool Precedes(const IteratorWrapper* a, const IteratorWrapper* b) const {
+    const int r = comparator_->Compare(a->key(), b->key());
+    if (direction_ == kForward) {
+      return r < 0 || (r == 0 && a < b);
+    } else {
+      return r > 0 || (r == 0 && a > b);
+    }
+  }
+
+  // Rebuild heap_ from the valid children and set current_ to its top.
+  void BuildHeap();
+
+  // Restore the heap order after the top child moved, dropping it if it
+  // is no longer valid, and set current_ to the new top.
+  void UpdateTop();
+
+  // Move heap_[pos] down until neither of its children precedes it.
+  void SiftDown(size_t pos);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
   const Comparator* comparator_;
   IteratorWrapper* children_;
   int n_;
+  std::vector<IteratorWrapper*> heap_;  // Valid children, heap ordered
   IteratorWrapper* current_;
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
+void MergingIterator::BuildHeap() {
+  heap_.clear();
   for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+    if (children_[i].Valid()) {
+      heap_.push_back(&children_[i]);
     }
   }
-  current_ = smallest;
+  for (size_t pos = heap_.size() / 2; pos > 0; pos--) {
+    SiftDown(pos - 1);
+  }
+  current_ = heap_.empty() ? nullptr : heap_[0];
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
-      }
+void MergingIterator::UpdateTop() {
+  assert(!heap_.empty() && heap_[0] == current_);
+  if (!current_->Valid()) {
+    heap_[0] = heap_.back();
+    heap_.pop_back();
+  }
+  if (heap_.empty()) {
+    current_ = nullptr;
+  } else {
+    SiftDown(0);
+    current_ = heap_[0];
+  }
+}
+
+void MergingIterator::SiftDown(size_t pos) {
+  const size_t size = heap_.size();
+  IteratorWrapper* item = heap_[pos];
+  while (true) {
+    size_t child = 2 * pos + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && Precedes(heap_[child + 1], heap_[child])) {
+      child++;
+    }
+    if (!Precedes(heap_[child], item)) {
+      break;
     }
+    heap_[pos] = heap_[child];
+    pos = child;
   }
-  current_ = largest;
+  heap_[pos] = item;
 }
 }  // namespace
 
@@ -0,0 +1,205 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+typedef std::map<std::string, std::string> KVMap;
+
+// An iterator over the sorted entries of a KVMap.
+class MapIterator : public Iterator {
+ public:
+  explicit MapIterator(const KVMap* map)
+      : map_(map), iter_(map->end()) {}
+
+  bool Valid() const override { return iter_ != map_->end(); }
+  void SeekToFirst() override { iter_ = map_->begin(); }
+  void SeekToLast() override {
+    iter_ = map_->empty() ? map_->end() : --map_->end();
+  }
+  void Seek(const Slice& target) override {
+    iter_ = map_->lower_bound(target.ToString());
+  }
+  void Next() override {
+    assert(Valid());
+    ++iter_;
+  }
+  void Prev() override {
+    assert(Valid());
+    if (iter_ == map_->begin()) {
+      iter_ = map_->end();
+    } else {
+      --iter_;
+    }
+  }
+  Slice key() const override { return iter_->first; }
+  Slice value() const override { return iter_->second; }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const KVMap* const map_;
+  KVMap::const_iterator iter_;
+};
+
+class MergerTest {
+ public:
+  MergerTest() : rnd_(301) {}
+
+  // Spread "n" random keys over "num_children" children, so that the
+  // key ranges of the children overlap.
+  void Build(int num_children, int n) {
+    children_.assign(num_children, KVMap());
+    model_.clear();
+    for (int i = 0; i < n; i++) {
+      const std::string key = test::RandomKey(&rnd_, 1 + rnd_.Uniform(4));
+      if (model_.count(key) > 0) {
+        continue;
+      }
+      const std::string value = "v" + std::to_string(i);
+      model_[key] = value;
+      children_[rnd_.Uniform(num_children)][key] = value;
+    }
+  }
+
+  Iterator* NewIterator() {
+    std::vector<Iterator*> list;
+    for (const KVMap& child : children_) {
+      list.push_back(new MapIterator(&child));
+    }
+    return NewMergingIterator(BytewiseComparator(), list.data(),
+                              static_cast<int>(list.size()));
+  }
+
+  std::string ToString(const KVMap::const_iterator& it) {
+    if (it == model_.end()) {
+      return "END";
+    }
+    return "'" + it->first + "->" + it->second + "'";
+  }
+
+  std::string ToString(const Iterator* it) {
+    if (!it->Valid()) {
+      return "END";
+    }
+    return "'" + it->key().ToString() + "->" + it->value().ToString() + "'";
+  }
+
+  // Drive the merging iterator and the model through the same random
+  // sequence of positioning calls.
+  void TestRandomAccess(int steps) {
+    Iterator* iter = NewIterator();
+    KVMap::const_iterator model_iter = model_.end();
+    for (int i = 0; i < steps; i++) {
+      switch (rnd_.Uniform(5)) {
+        case 0:
+          iter->SeekToFirst();
+          model_iter = model_.begin();
+          break;
+        case 1:
+          iter->SeekToLast();
+          model_iter = model_.empty() ? model_.end() : --model_.end();
+          break;
+        case 2: {
+          const std::string target =
+              test::RandomKey(&rnd_, 1 + rnd_.Uniform(4));
+          iter->Seek(target);
+          model_iter = model_.lower_bound(target);
+          break;
+        }
+        case 3:
+          if (iter->Valid()) {
+            iter->Next();
+            ++model_iter;
+          }
+          break;
+        case 4:
+          if (iter->Valid()) {
+            iter->Prev();
+            if (model_iter == model_.begin()) {
+              model_iter = model_.end();
+            } else {
+              --model_iter;
+            }
+          }
+          break;
+      }
+      ASSERT_EQ(ToString(model_iter), ToString(iter));
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+
+ protected:
+  Random rnd_;
+  std::vector<KVMap> children_;
+  KVMap model_;
+};
+
+TEST(MergerTest, Empty) {
+  Build(3, 0);
+  Iterator* iter = NewIterator();
+  iter->SeekToFirst();
+  ASSERT_TRUE(!iter->Valid());
+  iter->SeekToLast();
+  ASSERT_TRUE(!iter->Valid());
+  iter->Seek("foo");
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST(MergerTest, ChangeDirection) {
+  children_.assign(3, KVMap());
+  children_[0]["a"] = "0";
+  children_[0]["d"] = "0";
+  children_[1]["b"] = "1";
+  children_[1]["e"] = "1";
+  children_[2]["c"] = "2";
+  children_[2]["f"] = "2";
+  Iterator* iter = NewIterator();
+  iter->Seek("c");
+  ASSERT_EQ("c", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("d", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("c", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("b", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("c", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("d", iter->key().ToString());
+  iter->SeekToLast();
+  ASSERT_EQ("f", iter->key().ToString());
+  iter->Prev();
+  ASSERT_EQ("e", iter->key().ToString());
+  iter->Next();
+  ASSERT_EQ("f", iter->key().ToString());
+  iter->Next();
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST(MergerTest, Randomized) {
+  for (int num_children = 1; num_children <= 8; num_children++) {
+    for (int n : {1, 10, 100, 1000}) {
+      Build(num_children, n);
+      TestRandomAccess(2000);
+    }
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -4,11 +4,16 @@
 
 #include "leveldb/table.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -17,11 +22,25 @@
 
 namespace leveldb {
 
+// Once an iterator has read this many consecutive data blocks of a table,
+// it is considered a long scan (see ReadOptions::adaptive_readahead).
+static const int kLongScanBlocks = 4;
+
+// The readahead size of a long scan starts here and doubles with every
+// read of the file, up to the maximum.
+static const size_t kInitialReadaheadSize = 32 * 1024;
+static const size_t kMaxReadaheadSize = 256 * 1024;
+
 struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
     delete index_block;
+    delete properties;
+  }
+
+  Iterator* NewIndexIterator() const {
+    return index_block->NewIterator(options.comparator, index_delta_encoded);
   }
 
   Options options;
@@ -30,9 +49,12 @@ struct Table::Rep {
   uint64_t cache_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  bool filter_has_prefixes;  // Filters also hold the prefixes of the keys
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  bool index_delta_encoded;  // See Footer::delta_encoded_index()
+  TableProperties* properties;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -71,9 +93,12 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->index_delta_encoded = footer.delta_encoded_index();
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
     rep->filter_data = nullptr;
     rep->filter = nullptr;
+    rep->filter_has_prefixes = false;
+    rep->properties = nullptr;
     *table = new Table(rep);
     (*table)->ReadMeta(footer);
   }
@@ -82,10 +107,6 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
-  }
-
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -100,11 +121,24 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  iter->Seek(kPropertiesBlockName);
+  if (iter->Valid() && iter->key() == Slice(kPropertiesBlockName)) {
+    ReadProperties(iter->value());
+  }
+  if (rep_->options.filter_policy != nullptr) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  if (rep_->filter != nullptr && rep_->options.prefix_extractor != nullptr) {
+    iter->Seek("prefix_extractor");
+    if (iter->Valid() && iter->key() == Slice("prefix_extractor") &&
+        iter->value() == Slice(rep_->options.prefix_extractor->Name())) {
+      rep_->filter_has_prefixes = true;
+    }
   }
   delete iter;
   delete meta;
@@ -133,6 +167,30 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
 }
 
+void Table::ReadProperties(const Slice& properties_handle_value) {
+  Slice v = properties_handle_value;
+  BlockHandle properties_handle;
+  if (!properties_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, properties_handle, &contents).ok()) {
+    return;
+  }
+  Block block(contents);
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+  rep_->properties = new TableProperties;
+  ReadTableProperties(iter, rep_->properties);
+  delete iter;
+}
+
+const TableProperties* Table::GetProperties() const { return rep_->properties; }
+
 Table::~Table() { delete rep_; }
 
 static void DeleteBlock(void* arg, void* ignored) {
@@ -150,11 +208,98 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
+namespace {
+
+// Serves the reads of a table file from a buffer that is refilled with
+// reads of the following kInitialReadaheadSize..kMaxReadaheadSize bytes,
+// but never past "limit".  Not thread-safe: each ScanState has its own.
+class ReadaheadFile : public RandomAccessFile {
+ public:
+  ReadaheadFile(RandomAccessFile* file, uint64_t limit)
+      : file_(file),
+        limit_(limit),
+        passthrough_(false),
+        buffer_offset_(0),
+        readahead_size_(kInitialReadaheadSize) {}
+
+  // Called when reads stop being sequential
+  void ResetReadaheadSize() { readahead_size_ = kInitialReadaheadSize; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (passthrough_ || offset + n > limit_) {
+      return file_->Read(offset, n, result, scratch);
+    }
+    if (offset < buffer_offset_ ||
+        offset + n > buffer_offset_ + buffer_.size()) {
+      size_t size = std::max<size_t>(
+          n, std::min<uint64_t>(readahead_size_, limit_ - offset));
+      buffer_.resize(size);
+      Slice data;
+      Status s = file_->Read(offset, size, &data, &buffer_[0]);
+      if (!s.ok() || data.size() < n) {
+        buffer_.clear();
+        return s.ok() ? file_->Read(offset, n, result, scratch) : s;
+      }
+      if (data.data() != buffer_.data()) {
+        // The file hands out its own memory (e.g. it is mmap-ed), so
+        // copying it ahead of time gains nothing.
+        passthrough_ = true;
+        buffer_.clear();
+        *result = Slice(data.data(), n);
+        return s;
+      }
+      buffer_.resize(data.size());
+      buffer_offset_ = offset;
+      readahead_size_ = std::min(2 * readahead_size_, kMaxReadaheadSize);
+    }
+    memcpy(scratch, buffer_.data() + (offset - buffer_offset_), n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+ private:
+  RandomAccessFile* const file_;
+  const uint64_t limit_;
+  mutable bool passthrough_;
+  mutable std::string buffer_;  // Holds the file bytes at buffer_offset_
+  mutable uint64_t buffer_offset_;
+  mutable size_t readahead_size_;
+};
+
+}  // namespace
+
+struct Table::ScanState {
+  explicit ScanState(Table* t)
+      : table(t),
+        // Data blocks all lie before the metaindex block
+        file(t->rep_->file, t->rep_->metaindex_handle.offset()),
+        next_offset(0),
+        sequential_blocks(0) {}
+
+  Table* const table;
+  ReadaheadFile file;
+  uint64_t next_offset;   // Offset of the block after the last one read
+  int sequential_blocks;  // Number of consecutive blocks read
+};
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
+  return ReadDataBlock(reinterpret_cast<Table*>(arg), nullptr, options,
+                       index_value);
+}
+
+Iterator* Table::ScanBlockReader(void* arg, const ReadOptions& options,
+                                 const Slice& index_value) {
+  ScanState* scan = reinterpret_cast<ScanState*>(arg);
+  return ReadDataBlock(scan->table, scan, options, index_value);
+}
+
+Iterator* Table::ReadDataBlock(Table* table, ScanState* scan,
+                               const ReadOptions& options,
+                               const Slice& index_value) {
   Cache* block_cache = table->rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
@@ -165,6 +310,24 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   // We intentionally allow extra stuff in index_value so that we
   // can add more features in the future.
 
+  RandomAccessFile* file = table->rep_->file;
+  bool fill_cache = options.fill_cache;
+  if (s.ok() && scan != nullptr && options.adaptive_readahead) {
+    if (handle.offset() == scan->next_offset) {
+      scan->sequential_blocks++;
+    } else {
+      scan->sequential_blocks = 0;
+      scan->file.ResetReadaheadSize();
+    }
+    scan->next_offset = handle.offset() + handle.size() + kBlockTrailerSize;
+    if (scan->sequential_blocks >= kLongScanBlocks) {
+      // A long scan: read ahead, and keep its blocks out of the cache so
+      // that they do not evict the blocks of other reads
+      file = &scan->file;
+      fill_cache = false;
+    }
+  }
+
   if (s.ok()) {
     BlockContents contents;
     if (block_cache != nullptr) {
@@ -175,18 +338,22 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+      } else if (options.no_io) {
+        s = Status::Incomplete("block is not in the block cache");
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
-          if (contents.cachable && options.fill_cache) {
+          if (contents.cachable && fill_cache) {
             cache_handle = block_cache->Insert(key, block, block->size(),
                                                &DeleteCachedBlock);
           }
         }
       }
+    } else if (options.no_io) {
+      s = Status::Incomplete("no block cache");
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -207,17 +374,61 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+bool Table::BlockPrefixMayMatch(const Slice& index_value,
+                                const Slice& target) const {
+  const SliceTransform* prefix_extractor = rep_->options.prefix_extractor;
+  if (!rep_->filter_has_prefixes || !prefix_extractor->InDomain(target)) {
+    return true;
+  }
+  BlockHandle handle;
+  Slice input = index_value;
+  return !handle.DecodeFrom(&input).ok() ||
+         rep_->filter->KeyMayMatch(handle.offset(),
+                                   prefix_extractor->Transform(target));
+}
+
+bool Table::ScanPrefixMayMatch(void* arg, const Slice& index_value,
+                               const Slice& target) {
+  ScanState* scan = reinterpret_cast<ScanState*>(arg);
+  return scan->table->BlockPrefixMayMatch(index_value, target);
+}
+
+void Table::DeleteScanState(void* arg, void* ignored) {
+  delete reinterpret_cast<ScanState*>(arg);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  ScanState* scan = new ScanState(const_cast<Table*>(this));
+  Iterator* iter =
+      NewTwoLevelIterator(rep_->NewIndexIterator(), &Table::ScanBlockReader,
+                          scan, options, &Table::ScanPrefixMayMatch);
+  iter->RegisterCleanup(&Table::DeleteScanState, scan, nullptr);
+  return iter;
+}
+
+bool Table::PrefixMayMatch(const Slice& target) const {
+  if (!rep_->filter_has_prefixes) {
+    return true;
+  }
+  Iterator* iiter = rep_->NewIndexIterator();
+  iiter->Seek(target);
+  bool may_match = true;
+  if (iiter->Valid()) {
+    may_match = BlockPrefixMayMatch(iiter->value(), target);
+  }
+  delete iiter;
+  return may_match;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                                                const Slice&),
+                          Iterator** result_iter) {
+  if (result_iter != nullptr) {
+    *result_iter = nullptr;
+  }
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = rep_->NewIndexIterator();
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
@@ -229,11 +440,17 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
     } else {
       Iterator* block_iter = BlockReader(this, options, iiter->value());
       block_iter->Seek(k);
+      bool called = false;
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
+        called = true;
       }
       s = block_iter->status();
-      delete block_iter;
+      if (called && result_iter != nullptr) {
+        *result_iter = block_iter;
+      } else {
+        delete block_iter;
+      }
     }
   }
   if (s.ok()) {
@@ -244,8 +461,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = rep_->NewIndexIterator();
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
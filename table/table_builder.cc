@@ -10,6 +10,8 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/table_properties.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -22,6 +24,7 @@ struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
         index_block_options(opt),
+        meta_block_options(opt),
         file(f),
         offset(0),
         data_block(&options),
@@ -30,13 +33,17 @@ struct TableBuilder::Rep {
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+                         : new FilterBlockBuilder(opt.filter_policy,
+                                                  opt.prefix_extractor)),
         pending_index_entry(false) {
-    index_block_options.block_restart_interval = 1;
+    index_block_options.block_restart_interval =
+        opt.index_block_restart_interval;
+    meta_block_options.comparator = BytewiseComparator();
   }
 
   Options options;
   Options index_block_options;
+  Options meta_block_options;  // Meta block keys are ordered bytewise
   WritableFile* file;
   uint64_t offset;
   Status status;
@@ -46,6 +53,7 @@ struct TableBuilder::Rep {
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
+  TableProperties props;
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -82,12 +90,24 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.prefix_extractor != rep_->options.prefix_extractor) {
+    return Status::InvalidArgument(
+        "changing prefix extractor while building table");
+  }
+  if (options.delta_encode_index_handles !=
+      rep_->options.delta_encode_index_handles) {
+    return Status::InvalidArgument(
+        "changing index encoding while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
-  rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.block_restart_interval =
+      options.index_block_restart_interval;
+  rep_->meta_block_options = options;
+  rep_->meta_block_options.comparator = BytewiseComparator();
   return Status::OK();
 }
 
@@ -102,10 +122,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   if (r->pending_index_entry) {
     assert(r->data_block.empty());
     r->options.comparator->FindShortestSeparator(&r->last_key, key);
-    std::string handle_encoding;
-    r->pending_handle.EncodeTo(&handle_encoding);
-    r->index_block.Add(r->last_key, Slice(handle_encoding));
-    r->pending_index_entry = false;
+    AddIndexEntry();
   }
 
   if (r->filter_block != nullptr) {
@@ -114,6 +131,8 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
+  r->props.raw_key_size += key.size();
+  r->props.raw_value_size += value.size();
   r->data_block.Add(key, value);
 
   const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
@@ -122,14 +141,30 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::SetInternalKeyProperties(uint64_t num_deletions,
+                                            uint64_t smallest_seqno,
+                                            uint64_t largest_seqno) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  r->props.num_deletions = num_deletions;
+  r->props.smallest_seqno = smallest_seqno;
+  r->props.largest_seqno = largest_seqno;
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
   if (r->data_block.empty()) return;
   assert(!r->pending_index_entry);
+  const size_t raw_size = r->data_block.CurrentSizeEstimate();
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
+    r->props.num_data_blocks++;
+    r->props.raw_data_size += raw_size;
+    if (r->pending_handle.size() < raw_size) {
+      r->props.num_compressed_blocks++;
+    }
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
@@ -138,6 +173,21 @@ void TableBuilder::Flush() {
   }
 }
 
+// Adds the index entry that maps r->last_key to the block just written.
+void TableBuilder::AddIndexEntry() {
+  Rep* r = rep_;
+  std::string handle_encoding;
+  if (r->options.delta_encode_index_handles &&
+      !r->index_block.AtRestartPoint()) {
+    // The block starts where the previous one ended
+    PutVarint64(&handle_encoding, r->pending_handle.size());
+  } else {
+    r->pending_handle.EncodeTo(&handle_encoding);
+  }
+  r->index_block.Add(r->last_key, Slice(handle_encoding));
+  r->pending_index_entry = false;
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -201,39 +251,58 @@ Status TableBuilder::Finish() {
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, properties_block_handle,
+      metaindex_block_handle, index_block_handle;
+  r->props.num_entries = r->num_entries;
+  r->props.data_size = r->offset;
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
-    WriteRawBlock(r->filter_block->Finish(), kNoCompression,
-                  &filter_block_handle);
+    Slice filter_contents = r->filter_block->Finish();
+    r->props.filter_size = filter_contents.size();
+    WriteRawBlock(filter_contents, kNoCompression, &filter_block_handle);
+  }
+
+  // The index block is complete once it has an entry for the last block
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    AddIndexEntry();
+  }
+  r->props.index_size = r->index_block.CurrentSizeEstimate();
+
+  // Write properties block
+  if (ok()) {
+    BlockBuilder properties_block(&r->meta_block_options);
+    AddTableProperties(r->props, &properties_block);
+    WriteBlock(&properties_block, &properties_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    BlockBuilder meta_index_block(&r->meta_block_options);
+    std::string handle_encoding;
     if (r->filter_block != nullptr) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
       key.append(r->options.filter_policy->Name());
-      std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
 
-    // TODO(postrelease): Add stats and other meta blocks
+    handle_encoding.clear();
+    properties_block_handle.EncodeTo(&handle_encoding);
+    meta_index_block.Add(kPropertiesBlockName, handle_encoding);
+
+    if (r->filter_block != nullptr && r->options.prefix_extractor != nullptr) {
+      // Record which transform produced the prefixes in the filters
+      meta_index_block.Add("prefix_extractor",
+                           r->options.prefix_extractor->Name());
+    }
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
     WriteBlock(&r->index_block, &index_block_handle);
   }
 
@@ -242,6 +311,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_delta_encoded_index(r->options.delta_encode_index_handles);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A properties block maps the name of every property to its value,
+// encoded as a varint64.
+
+#include "leveldb/table_properties.h"
+
+#include "leveldb/iterator.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+namespace {
+
+struct Property {
+  const char* name;
+  uint64_t TableProperties::*field;
+};
+
+// Sorted by name, the order in which they are stored.
+const Property kProperties[] = {
+    {"leveldb.data.size", &TableProperties::data_size},
+    {"leveldb.filter.size", &TableProperties::filter_size},
+    {"leveldb.index.size", &TableProperties::index_size},
+    {"leveldb.largest.seqno", &TableProperties::largest_seqno},
+    {"leveldb.num.compressed.blocks", &TableProperties::num_compressed_blocks},
+    {"leveldb.num.data.blocks", &TableProperties::num_data_blocks},
+    {"leveldb.num.deletions", &TableProperties::num_deletions},
+    {"leveldb.num.entries", &TableProperties::num_entries},
+    {"leveldb.raw.data.size", &TableProperties::raw_data_size},
+    {"leveldb.raw.key.size", &TableProperties::raw_key_size},
+    {"leveldb.raw.value.size", &TableProperties::raw_value_size},
+    {"leveldb.smallest.seqno", &TableProperties::smallest_seqno},
+};
+
+}  // anonymous namespace
+
+void AddTableProperties(const TableProperties& props, BlockBuilder* block) {
+  std::string value;
+  for (const Property& property : kProperties) {
+    value.clear();
+    PutVarint64(&value, props.*property.field);
+    block->Add(property.name, value);
+  }
+}
+
+void ReadTableProperties(Iterator* iter, TableProperties* props) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    for (const Property& property : kProperties) {
+      if (iter->key() == Slice(property.name)) {
+        Slice input = iter->value();
+        uint64_t v;
+        if (GetVarint64(&input, &v)) {
+          props->*property.field = v;
+        }
+        break;
+      }
+    }
+  }
+}
+
+static void AppendProperty(std::string* r, const char* name, uint64_t v) {
+  r->append(name);
+  r->append(": ");
+  AppendNumberTo(r, v);
+  r->push_back('\n');
+}
+
+std::string TableProperties::ToString() const {
+  std::string r;
+  AppendProperty(&r, "entries", num_entries);
+  AppendProperty(&r, "deletions", num_deletions);
+  AppendProperty(&r, "smallest seqno", smallest_seqno);
+  AppendProperty(&r, "largest seqno", largest_seqno);
+  AppendProperty(&r, "raw key size", raw_key_size);
+  AppendProperty(&r, "raw value size", raw_value_size);
+  AppendProperty(&r, "data blocks", num_data_blocks);
+  AppendProperty(&r, "compressed data blocks", num_compressed_blocks);
+  AppendProperty(&r, "raw data size", raw_data_size);
+  AppendProperty(&r, "data size", data_size);
+  AppendProperty(&r, "index size", index_size);
+  AppendProperty(&r, "filter size", filter_size);
+  return r;
+}
+
+}  // namespace leveldb
@@ -10,10 +10,13 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
@@ -109,11 +112,12 @@ class StringSink : public WritableFile {
 class StringSource : public RandomAccessFile {
  public:
   StringSource(const Slice& contents)
-      : contents_(contents.data(), contents.size()) {}
+      : contents_(contents.data(), contents.size()), num_reads_(0) {}
 
   ~StringSource() override = default;
 
   uint64_t Size() const { return contents_.size(); }
+  int num_reads() const { return num_reads_; }
 
   Status Read(uint64_t offset, size_t n, Slice* result,
               char* scratch) const override {
@@ -123,6 +127,7 @@ class StringSource : public RandomAccessFile {
     if (offset + n > contents_.size()) {
       n = contents_.size() - offset;
     }
+    num_reads_++;
     memcpy(scratch, &contents_[offset], n);
     *result = Slice(scratch, n);
     return Status::OK();
@@ -130,6 +135,7 @@ class StringSource : public RandomAccessFile {
 
  private:
   std::string contents_;
+  mutable int num_reads_;
 };
 
 typedef std::map<std::string, std::string, STLLessThan> KVMap;
@@ -370,7 +376,13 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  DELTA_INDEX_TABLE_TEST,
+  BLOCK_TEST,
+  MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
@@ -386,6 +398,14 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    // Delta-encoded index blocks, with the same restart interval as the
+    // data blocks
+    {DELTA_INDEX_TABLE_TEST, false, 16},
+    {DELTA_INDEX_TABLE_TEST, false, 1},
+    {DELTA_INDEX_TABLE_TEST, false, 1024},
+    {DELTA_INDEX_TABLE_TEST, true, 16},
+    {DELTA_INDEX_TABLE_TEST, true, 1},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -423,6 +443,11 @@ class Harness {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case DELTA_INDEX_TABLE_TEST:
+        options_.delta_encode_index_handles = true;
+        options_.index_block_restart_interval = args.restart_interval;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
@@ -830,6 +855,153 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+TEST(TableTest, LongScanReadahead) {
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    std::string value;
+    builder.Add(key, test::RandomString(&rnd, 100, &value));
+  }
+  ASSERT_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  options.block_cache = NewLRUCache(100 << 20);
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+
+  // A short range read goes through the cache
+  ReadOptions read_options;
+  Iterator* iter = table->NewIterator(read_options);
+  iter->Seek("k000500");
+  for (int i = 0; i < 10; i++) {
+    ASSERT_TRUE(iter->Valid());
+    iter->Next();
+  }
+  delete iter;
+  const size_t short_scan_charge = options.block_cache->TotalCharge();
+  ASSERT_GT(short_scan_charge, 0);
+
+  // A full scan of the ~100 data blocks reads ahead and caches only the
+  // first few blocks
+  int reads = source.num_reads();
+  iter = table->NewIterator(read_options);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_EQ(1000, count);
+  ASSERT_LT(source.num_reads() - reads, 20);
+  ASSERT_LT(options.block_cache->TotalCharge(),
+            short_scan_charge + 10 * options.block_size);
+
+  // Unless adaptive readahead is disabled
+  read_options.adaptive_readahead = false;
+  reads = source.num_reads();
+  iter = table->NewIterator(read_options);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+  }
+  ASSERT_OK(iter->status());
+  delete iter;
+  ASSERT_GT(source.num_reads() - reads, 50);
+  ASSERT_GT(options.block_cache->TotalCharge(), 50 * options.block_size);
+
+  delete table;
+  delete options.block_cache;
+}
+
+// Builds a table of many small blocks and returns the size of its index
+// block.
+static uint64_t IndexBlockSize(const Options& options) {
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  Random rnd(301);
+  for (int i = 0; i < 10000; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "user%012d", i);
+    std::string value;
+    builder.Add(key, test::RandomString(&rnd, 100, &value));
+  }
+  ASSERT_OK(builder.Finish());
+
+  Slice footer_input(sink.contents().data() + sink.contents().size() -
+                         Footer::kEncodedLength,
+                     Footer::kEncodedLength);
+  Footer footer;
+  ASSERT_OK(footer.DecodeFrom(&footer_input));
+  ASSERT_EQ(options.delta_encode_index_handles, footer.delta_encoded_index());
+  return footer.index_handle().size();
+}
+
+TEST(TableTest, DeltaEncodedIndexSize) {
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  const uint64_t plain_size = IndexBlockSize(options);
+  options.index_block_restart_interval = 16;
+  const uint64_t restart_size = IndexBlockSize(options);
+  options.delta_encode_index_handles = true;
+  const uint64_t delta_size = IndexBlockSize(options);
+  ASSERT_LT(restart_size, plain_size);
+  ASSERT_LT(delta_size, restart_size);
+  ASSERT_LT(delta_size, plain_size / 2);
+
+  // Every entry is a restart point with an interval of 1, so there is
+  // nothing to delta-encode
+  options.index_block_restart_interval = 1;
+  ASSERT_EQ(plain_size, IndexBlockSize(options));
+}
+
+TEST(TableTest, Properties) {
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  Random rnd(301);
+  for (int i = 0; i < 1000; i++) {
+    char key[10];
+    std::snprintf(key, sizeof(key), "k%06d", i);
+    std::string value;
+    builder.Add(key, test::RandomString(&rnd, 100, &value));
+  }
+  builder.SetInternalKeyProperties(10, 5, 1004);
+  ASSERT_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  Table* table;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table));
+  const TableProperties* props = table->GetProperties();
+  ASSERT_TRUE(props != nullptr);
+  ASSERT_EQ(1000, props->num_entries);
+  ASSERT_EQ(7000, props->raw_key_size);
+  ASSERT_EQ(100000, props->raw_value_size);
+  ASSERT_EQ(10, props->num_deletions);
+  ASSERT_EQ(5, props->smallest_seqno);
+  ASSERT_EQ(1004, props->largest_seqno);
+
+  // The data blocks come first and are stored as they are
+  ASSERT_GT(props->num_data_blocks, 50);
+  ASSERT_EQ(0, props->num_compressed_blocks);
+  ASSERT_EQ(props->num_data_blocks * kBlockTrailerSize + props->raw_data_size,
+            props->data_size);
+  ASSERT_TRUE(Between(table->ApproximateOffsetOf("zzz"), props->data_size,
+                      props->data_size + props->filter_size + 1000));
+  ASSERT_GT(props->index_size, 0);
+  ASSERT_GT(props->filter_size, 0);
+  ASSERT_LT(props->index_size + props->filter_size, sink.contents().size());
+  delete table;
+  delete options.filter_policy;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
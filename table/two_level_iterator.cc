@@ -14,11 +14,13 @@ namespace leveldb {
 namespace {
 
 typedef Iterator* (*BlockFunction)(void*, const ReadOptions&, const Slice&);
+typedef bool (*PrefixMayMatchFunction)(void*, const Slice&, const Slice&);
 
 class TwoLevelIterator : public Iterator {
  public:
   TwoLevelIterator(Iterator* index_iter, BlockFunction block_function,
-                   void* arg, const ReadOptions& options);
+                   void* arg, const ReadOptions& options,
+                   PrefixMayMatchFunction prefix_may_match);
 
   ~TwoLevelIterator() override;
 
@@ -58,6 +60,7 @@ class TwoLevelIterator : public Iterator {
   void InitDataBlock();
 
   BlockFunction block_function_;
+  PrefixMayMatchFunction prefix_may_match_;  // nullptr unless prefix seeks
   void* arg_;
   const ReadOptions options_;
   Status status_;
@@ -70,8 +73,11 @@ class TwoLevelIterator : public Iterator {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   PrefixMayMatchFunction prefix_may_match)
     : block_function_(block_function),
+      prefix_may_match_(options.prefix_same_as_start ? prefix_may_match
+                                                      : nullptr),
       arg_(arg),
       options_(options),
       index_iter_(index_iter),
@@ -81,6 +87,13 @@ TwoLevelIterator::~TwoLevelIterator() = default;
 
 void TwoLevelIterator::Seek(const Slice& target) {
   index_iter_.Seek(target);
+  if (prefix_may_match_ != nullptr && index_iter_.Valid() &&
+      !(*prefix_may_match_)(arg_, index_iter_.value(), target)) {
+    // The first entry at or after target lives in this block, so no
+    // later entry shares the prefix of target either.
+    SetDataIterator(nullptr);
+    return;
+  }
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
   SkipEmptyDataBlocksForward();
@@ -164,8 +177,10 @@ void TwoLevelIterator::InitDataBlock() {
 
 Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function, void* arg,
-                              const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+                              const ReadOptions& options,
+                              PrefixMayMatchFunction prefix_may_match) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              prefix_may_match);
 }
 
 }  // namespace leveldb
@@ -20,11 +20,19 @@ struct ReadOptions;
 //
 // Uses a supplied function to convert an index_iter value into
 // an iterator over the contents of the corresponding block.
+//
+// If options.prefix_same_as_start is set and "prefix_may_match" is
+// non-null, Seek(target) first asks prefix_may_match() whether the block
+// the target falls into may hold keys with the prefix of "target".  If
+// not, no key at or after the target has that prefix, and the iterator
+// becomes invalid without reading the block.
 Iterator* NewTwoLevelIterator(
     Iterator* index_iter,
     Iterator* (*block_function)(void* arg, const ReadOptions& options,
                                 const Slice& index_value),
-    void* arg, const ReadOptions& options);
+    void* arg, const ReadOptions& options,
+    bool (*prefix_may_match)(void* arg, const Slice& index_value,
+                             const Slice& target) = nullptr);
 
 }  // namespace leveldb
 
@@ -12,12 +12,25 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::ReuseWritableFile(const std::string& fname,
+                              const std::string& old_fname,
+                              WritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = nullptr;
+    return s;
+  }
+  return NewWritableFile(fname, result);
+}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
 
 WritableFile::~WritableFile() = default;
 
+Status WritableFile::Preallocate(uint64_t size) { return Status::OK(); }
+
 Logger::~Logger() = default;
 
 FileLock::~FileLock() = default;
@@ -303,6 +303,21 @@ class PosixWritableFile final : public WritableFile {
 
   Status Flush() override { return FlushBuffer(); }
 
+  Status Preallocate(uint64_t size) override {
+#if HAVE_FALLOCATE
+    // FALLOC_FL_KEEP_SIZE reserves the extents without changing the file
+    // length, so readers never see the preallocated region.
+    if (::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, size) < 0 &&
+        errno != EOPNOTSUPP) {
+      return PosixError(filename_, errno);
+    }
+#else
+    // Silence compiler warnings about unused arguments.
+    (void)size;
+#endif  // HAVE_FALLOCATE
+    return Status::OK();
+  }
+
   Status Sync() override {
     // Ensure new files referred to by the manifest are in the filesystem.
     //
@@ -567,6 +582,25 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status ReuseWritableFile(const std::string& filename,
+                           const std::string& old_filename,
+                           WritableFile** result) override {
+    if (::rename(old_filename.c_str(), filename.c_str()) != 0) {
+      *result = nullptr;
+      return PosixError(old_filename, errno);
+    }
+
+    // Not O_TRUNC: the existing blocks are overwritten in place.
+    int fd = ::open(filename.c_str(), O_WRONLY | kOpenBaseFlags, 0644);
+    if (fd < 0) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+
+    *result = new PosixWritableFile(filename, fd);
+    return Status::OK();
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
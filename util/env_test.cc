@@ -220,6 +220,38 @@ TEST(EnvTest, ReopenAppendableFile) {
   env_->DeleteFile(test_file_name);
 }
 
+TEST(EnvTest, ReuseWritableFile) {
+  std::string test_dir;
+  ASSERT_OK(env_->GetTestDirectory(&test_dir));
+  std::string old_file_name = test_dir + "/reuse_writable_file_old.txt";
+  std::string test_file_name = test_dir + "/reuse_writable_file.txt";
+  env_->DeleteFile(old_file_name);
+  env_->DeleteFile(test_file_name);
+
+  WritableFile* writable_file;
+  ASSERT_OK(env_->NewWritableFile(old_file_name, &writable_file));
+  std::string data("hello world!");
+  ASSERT_OK(writable_file->Append(data));
+  ASSERT_OK(writable_file->Close());
+  delete writable_file;
+
+  ASSERT_OK(env_->ReuseWritableFile(test_file_name, old_file_name,
+                                    &writable_file));
+  ASSERT_TRUE(!env_->FileExists(old_file_name));
+  ASSERT_OK(writable_file->Preallocate(1 << 20));
+  data = "42";
+  ASSERT_OK(writable_file->Append(data));
+  ASSERT_OK(writable_file->Close());
+  delete writable_file;
+
+  // The old contents may or may not have been truncated, but the new data
+  // is at the start of the file and preallocation does not change its size.
+  ASSERT_OK(ReadFileToString(env_, test_file_name, &data));
+  ASSERT_EQ(std::string("42"), data.substr(0, 2));
+  ASSERT_LE(data.size(), 12);
+  env_->DeleteFile(test_file_name);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
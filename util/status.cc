@@ -60,6 +60,9 @@ std::string Status::ToString() const {
       case kIOError:
         type = "IO error: ";
         break;
+      case kIncomplete:
+        type = "Result incomplete: ";
+        break;
       default:
         snprintf(tmp, sizeof(tmp),
                  "Unknown code(%d): ", static_cast<int>(code()));